@@ -16,23 +16,14 @@ TEMPLATE = app
 # any feature of Qt which has been marked as deprecated (the exact warnings
 # depend on your compiler). Please consult the documentation of the
 # deprecated API in order to know how to port your code away from it.
-DEFINES += QT_DEPRECATED_WARNINGS
-DEFINES += CTRL_FOC=1
-DEFINES += CTRL_SINE=0
-DEFINES += CONTROL=1
-
-DEFINES += STM32F1
+# (QT_DEPRECATED_WARNINGS and the firmware build defines live in sim.pri)
 
 # You can also make your code fail to compile if you use deprecated APIs.
 # In order to do so, uncomment the following line.
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
-CONFIG += c++11
-
-INCLUDEPATH += $$PWD/stm32-sine/include
-INCLUDEPATH += $$PWD/stm32-sine/libopencm3/include
-INCLUDEPATH += $$PWD/stm32-sine/libopeninv/include
+include(sim.pri)
 
 SOURCES += \
         main.cpp \
@@ -40,29 +31,23 @@ SOURCES += \
     chart.cpp \
     chartview.cpp \
     datagraph.cpp \
-    motormodel.cpp \
-    stm32-sine/libopeninv/src/params.cpp \
-    stm32-sine/libopeninv/src/picontroller.cpp \
-    stm32-sine/libopeninv/src/sine_core.cpp \
-    stm32-sine/src/pwmgeneration-foc.cpp \
-    stm32-sine/libopeninv/src/my_string.c \
-    stm32-sine/libopeninv/src/errormessage.cpp \
-    stm32-sine/libopeninv/src/foc.cpp \
-    teststubs.c \
-    cpp_teststubs.cpp \
-    stm32-sine/src/pwmgeneration.cpp \
     idiqgraph.cpp \
-    terminal_stubs.cpp
+    mapview.cpp \
+    minmaxpyramid.cpp \
+    plotwidget.cpp \
+    simworker.cpp
 
 HEADERS += \
         mainwindow.h \
     chart.h \
     chartview.h \
     datagraph.h \
-    motormodel.h \
-    stm32-sine/include/pwmgeneration.h \
-    teststubs.h \
-    idiqgraph.h
+    idiqgraph.h \
+    mapview.h \
+    minmaxpyramid.h \
+    plotwidget.h \
+    simworker.h \
+    spscring.h
 
 FORMS += \
         mainwindow.ui
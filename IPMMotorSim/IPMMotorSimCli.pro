@@ -0,0 +1,40 @@
+#-------------------------------------------------
+#
+# Headless command line runner, no QtWidgets/QtCharts dependency.
+# Build with: qmake IPMMotorSimCli.pro && make -f Makefile.cli
+#
+#-------------------------------------------------
+
+QT += core
+QT -= gui
+
+TARGET = IPMMotorSimCli
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+# Allows the GUI and CLI projects to be built in the same directory
+MAKEFILE = Makefile.cli
+
+# Traces are written to CSV and analysed, keep them at full precision
+CONFIG += trace_double
+
+include(sim.pri)
+
+SOURCES += \
+    simcli.cpp \
+    scenario.cpp \
+    convergence.cpp \
+    sweep.cpp \
+    efficiencymap.cpp
+
+HEADERS += \
+    scenario.h \
+    convergence.h \
+    sweep.h \
+    efficiencymap.h
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
@@ -0,0 +1,133 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "batchcheck.h"
+#include <QVector>
+#include <QElapsedTimer>
+#include "motormodelbatch.h"
+
+//phase voltages for dq voltages at an electrical angle, as stepOpenLoop() in the convergence report
+static void openLoopVoltages(double elecPosition, double Vd, double Vq, double &Va, double &Vb, double &Vc)
+{
+    double angle = qDegreesToRadians(elecPosition);
+    double Valpha = (Vd * qCos(angle)) - (Vq * qSin(angle));
+    double Vbeta = (Vd * qSin(angle)) + (Vq * qCos(angle));
+    Va = Valpha;
+    Vb = (-Valpha + (qSqrt(3.0) * Vbeta)) / 2.0;
+    Vc = (-Valpha - (qSqrt(3.0) * Vbeta)) / 2.0;
+}
+
+//the single rate Euler model with reference trig, the only one the batch reproduces
+static MotorModel *createMotor(Scenario &scenario)
+{
+    MotorModel *motor = scenario.CreateMotor();
+    motor->setIntegrator(INTEG_EULER);
+    motor->setTrigMode(TRIG_REFERENCE);
+    motor->setMechDivider(1);
+    motor->setMechInterp(false);
+    motor->setDyno(false);
+    motor->setSyncDelay(0); //angle used for the voltages must be the model angle
+    return motor;
+}
+
+static MotorModelBatch *createBatch(Scenario &scenario, int count, bool reference)
+{
+    MotorModelBatch *batch = new MotorModelBatch(count, 1.0 / scenario.getValue("LoopFreq"));
+    for(int i = 0; i < count; i++)
+    {
+        batch->setInstance(i, scenario.getValue("wheelSize"), scenario.getValue("gearRatio"), scenario.getValue("RoadGradient")/100.0, scenario.getValue("vehicleWeight"),
+                           scenario.getValue("Lq")/1000, scenario.getValue("Ld")/1000, scenario.getValue("Rs"), scenario.getPoles(), scenario.getFluxLinkage()/1000,
+                           0, scenario.getValue("SamplingPoint")/100.0);
+    }
+    batch->setReferenceMode(reference);
+    return batch;
+}
+
+//largest difference in any phase or dq current between a batch lane and its motor
+static double laneError(MotorModelBatch *batch, int i, MotorModel *motor)
+{
+    double err = qMax(qAbs(batch->getId(i) - motor->getId()), qAbs(batch->getIq(i) - motor->getIq()));
+    err = qMax(err, qMax(qAbs(batch->getIaSamp(i) - motor->getIaSamp()), qAbs(batch->getIbSamp(i) - motor->getIbSamp())));
+    err = qMax(err, qAbs(batch->getIcSamp(i) - motor->getIcSamp()));
+    return qIsNaN(err) ? qInf() : err;
+}
+
+bool BatchCheckReport(Scenario &scenario, int count, double duration, QTextStream &out)
+{
+    count = qMax(count, 1);
+    double Vd = scenario.getValue("ConvVd");
+    int steps = int(duration * scenario.getValue("LoopFreq"));
+    QVector<double> Vq(count), Va(count), Vb(count), Vc(count);
+    for(int i = 0; i < count; i++)
+        Vq[i] = scenario.getValue("ConvVq") * (i + 1) / count;
+
+    //one MotorModel per lane, their voltages drive the reference batch so both see exactly the same inputs
+    QVector<MotorModel *> motors(count);
+    for(int i = 0; i < count; i++)
+        motors[i] = createMotor(scenario);
+    MotorModelBatch *reference = createBatch(scenario, count, true);
+    QElapsedTimer timer;
+    qint64 scalarNs = 0, referenceNs = 0;
+    double refErr = 0, refRpmErr = 0;
+    for(int k = 0; k < steps; k++)
+    {
+        for(int i = 0; i < count; i++)
+            openLoopVoltages(motors[i]->getElecPosition(), Vd, Vq[i], Va[i], Vb[i], Vc[i]);
+        timer.start();
+        for(int i = 0; i < count; i++)
+            motors[i]->Step(Va[i], Vb[i], Vc[i]);
+        scalarNs += timer.nsecsElapsed();
+        timer.start();
+        reference->Step(Va.constData(), Vb.constData(), Vc.constData());
+        referenceNs += timer.nsecsElapsed();
+        for(int i = 0; i < count; i++)
+        {
+            refErr = qMax(refErr, laneError(reference, i, motors[i]));
+            refRpmErr = qMax(refRpmErr, qAbs(reference->getMotorFreq(i) - motors[i]->getMotorFreq()) * 60);
+        }
+    }
+    delete reference;
+
+    //fast mode runs on its own angles, so it is compared at the end
+    MotorModelBatch *fast = createBatch(scenario, count, false);
+    qint64 fastNs = 0;
+    for(int k = 0; k < steps; k++)
+    {
+        for(int i = 0; i < count; i++)
+            openLoopVoltages(fast->getElecPosition(i), Vd, Vq[i], Va[i], Vb[i], Vc[i]);
+        timer.start();
+        fast->Step(Va.constData(), Vb.constData(), Vc.constData());
+        fastNs += timer.nsecsElapsed();
+    }
+    double fastErr = 0, fastRpmErr = 0;
+    for(int i = 0; i < count; i++)
+    {
+        fastErr = qMax(fastErr, laneError(fast, i, motors[i]));
+        fastRpmErr = qMax(fastRpmErr, qAbs(fast->getMotorFreq(i) - motors[i]->getMotorFreq()) * 60);
+        delete motors[i];
+    }
+    delete fast;
+
+    out << "Batch model against MotorModel, " << count << " lanes, " << steps << " steps, Vd=" << Vd << " Vq up to " << scenario.getValue("ConvVq") << "\n";
+    out << "model,time_ms,max_err_A,rpm_err\n";
+    out << "scalar," << (scalarNs / 1e6) << ",0,0\n";
+    out << "batch_reference," << (referenceNs / 1e6) << ',' << refErr << ',' << refRpmErr << "\n";
+    out << "batch_fast," << (fastNs / 1e6) << ',' << fastErr << ',' << fastRpmErr << "\n";
+    return refErr == 0 && refRpmErr == 0;
+}
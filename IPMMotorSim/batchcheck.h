@@ -0,0 +1,32 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BATCHCHECK_H
+#define BATCHCHECK_H
+
+#include <QTextStream>
+#include "scenario.h"
+
+//Runs a batch of open loop motors through MotorModelBatch and through one MotorModel each
+//Lane i is driven at ConvVd and (i+1)/count of ConvVq so the lanes differ
+//Reference mode must match MotorModel bit for bit, the fast mode error and the time taken by each are reported
+//Returns false if the reference mode lanes don't match
+bool BatchCheckReport(Scenario &scenario, int count, double duration, QTextStream &out);
+
+#endif // BATCHCHECK_H
@@ -0,0 +1,178 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "binlogwriter.h"
+#include <QFileInfo>
+#include <QDir>
+#include <QDebug>
+#include <string.h>
+
+BinaryLogWriter::BinaryLogWriter()
+    :m_fileName{"logfile.bin"}, m_rotateBytes{0}, m_open{false}, m_fill{0}, m_quit{false}, m_fileBytes{0}, m_fileIndex{0}, m_rotate{true}
+{
+}
+
+BinaryLogWriter::~BinaryLogWriter()
+{
+    Close();
+}
+
+BinaryLogWriter &BinaryLogWriter::terminalLog(void)
+{
+    static BinaryLogWriter log;
+    return log;
+}
+
+void BinaryLogWriter::setOutput(const QString &fileName, qint64 rotateBytes)
+{
+    Close();
+    m_fileName = fileName;
+    m_rotateBytes = rotateBytes;
+    m_error.clear();
+}
+
+QString BinaryLogWriter::rotatedName(const QString &fileName, int index)
+{
+    if(index == 0)
+        return fileName;
+    QFileInfo info(fileName);
+    QString name = info.completeBaseName() + QString(".%1").arg(index);
+    if(!info.suffix().isEmpty())
+        name += "." + info.suffix();
+    return info.dir().filePath(name);
+}
+
+//the first file is opened here so a bad path is reported to the caller rather than lost in the writer thread
+bool BinaryLogWriter::Open(const QByteArray &header)
+{
+    if(m_open)
+        return true;
+    m_header = header;
+    m_fileIndex = 0;
+    m_rotate = true;
+    if(!OpenFile())
+    {
+        m_error = "Unable to write binary log " + m_file.fileName();
+        return false;
+    }
+
+    //blocks are only allocated once logging is used, and kept for the next run
+    m_pending.clear();
+    m_free.clear();
+    for(int i = 0; i < BINLOG_BLOCKS; i++)
+    {
+        m_blocks[i].resize(BINLOG_BLOCK_SIZE);
+        m_used[i] = 0;
+        if(i > 0)
+            m_free.append(i);
+    }
+    m_fill = 0;
+    m_quit = false;
+    m_open = true;
+    start();
+    return true;
+}
+
+bool BinaryLogWriter::OpenFile(void)
+{
+    m_file.close();
+    m_file.setFileName(rotatedName(m_fileName, m_fileIndex));
+    if(!m_file.open(QFile::WriteOnly))
+        return false;
+    m_fileBytes = m_file.write(m_header);
+    return true;
+}
+
+//simulation thread, a copy unless the block is full
+void BinaryLogWriter::Append(const char *data, int len)
+{
+    if(m_used[m_fill] + len > BINLOG_BLOCK_SIZE)
+        Submit();
+    if(len > BINLOG_BLOCK_SIZE) //never the case for firmware packets
+        len = BINLOG_BLOCK_SIZE;
+    memcpy(m_blocks[m_fill].data() + m_used[m_fill], data, len);
+    m_used[m_fill] += len;
+}
+
+//hands the fill block to the writer thread, waits if it hasn't finished with the other one
+void BinaryLogWriter::Submit(void)
+{
+    QMutexLocker locker(&m_mutex);
+    m_pending.append(m_fill);
+    m_wake.wakeAll();
+    while(m_free.isEmpty())
+        m_written.wait(&m_mutex);
+    m_fill = m_free.takeFirst();
+    m_used[m_fill] = 0;
+}
+
+void BinaryLogWriter::Close(void)
+{
+    if(!m_open)
+        return;
+    if(m_used[m_fill] > 0)
+        Submit();
+    m_mutex.lock();
+    m_quit = true;
+    m_wake.wakeAll();
+    m_mutex.unlock();
+    wait();
+    m_file.close();
+    m_open = false;
+}
+
+void BinaryLogWriter::run()
+{
+    while(true)
+    {
+        m_mutex.lock();
+        while(m_pending.isEmpty() && !m_quit)
+            m_wake.wait(&m_mutex);
+        if(m_pending.isEmpty()) //only once everything queued before the quit is written
+        {
+            m_mutex.unlock();
+            return;
+        }
+        int block = m_pending.first();
+        m_mutex.unlock();
+
+        int len = m_used[block];
+        if(m_rotate && m_rotateBytes > 0 && m_fileBytes > m_header.size() && m_fileBytes + len > m_rotateBytes)
+        {
+            m_fileIndex++;
+            if(!OpenFile())
+            {
+                qWarning() << "Unable to write binary log" << m_file.fileName() << ", no further rotation";
+                m_fileIndex--; //keep going in the file we had
+                m_file.setFileName(rotatedName(m_fileName, m_fileIndex));
+                m_file.open(QFile::WriteOnly | QFile::Append);
+                m_fileBytes = m_file.size();
+                m_rotate = false;
+            }
+        }
+        if(m_file.isOpen())
+            m_fileBytes += m_file.write(m_blocks[block].constData(), len);
+
+        m_mutex.lock();
+        m_pending.removeFirst();
+        m_free.append(block);
+        m_written.wakeAll();
+        m_mutex.unlock();
+    }
+}
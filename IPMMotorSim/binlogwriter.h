@@ -0,0 +1,83 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BINLOGWRITER_H
+#define BINLOGWRITER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QFile>
+#include <QByteArray>
+#include <QString>
+#include <QList>
+
+#define BINLOG_BLOCK_SIZE (1 << 20) //bytes, packets are copied into a block and whole blocks are written
+#define BINLOG_BLOCKS 2 //one being filled while the other is written
+
+//Binary log file written from a background thread
+//The simulation thread only copies packets into a pre-allocated block, full blocks are handed to the writer thread
+//Files are rotated at block boundaries once they reach the rotate size, each file starts with the header so it can be decoded on its own
+//Packets are never split across blocks, or files
+class BinaryLogWriter : public QThread
+{
+public:
+    BinaryLogWriter();
+    ~BinaryLogWriter();
+    void setOutput(const QString &fileName, qint64 rotateBytes = 0); //0 never rotates, closes an open log
+    QString getFileName(void) {return m_fileName;}
+    bool Open(const QByteArray &header); //starts the writer thread
+    bool isOpen(void) {return m_open;}
+    bool hasFailed(void) {return !m_error.isEmpty();} //cleared by setOutput()
+    QString getError(void) {return m_error;}
+    void Append(const char *data, int len);
+    void Close(void); //writes what is left and waits for the writer thread
+    static QString rotatedName(const QString &fileName, int index); //logfile.bin, logfile.1.bin, logfile.2.bin...
+    static BinaryLogWriter &terminalLog(void); //the one Terminal::SendBinary() writes to
+
+protected:
+    void run();
+
+private:
+    void Submit(void);
+    bool OpenFile(void);
+
+    QString m_fileName;
+    qint64 m_rotateBytes;
+    QByteArray m_header;
+    bool m_open;
+    QString m_error;
+
+    QByteArray m_blocks[BINLOG_BLOCKS];
+    int m_used[BINLOG_BLOCKS];
+    int m_fill; //block being filled by Append()
+    QMutex m_mutex; //guards the queues and m_quit
+    QWaitCondition m_wake; //work for the writer thread
+    QWaitCondition m_written; //a block is free again
+    QList<int> m_pending; //full blocks in file order
+    QList<int> m_free;
+    bool m_quit;
+
+    QFile m_file; //writer thread only while open
+    qint64 m_fileBytes;
+    int m_fileIndex;
+    bool m_rotate; //cleared if a rotated file can't be opened, the rest goes in the current one
+};
+
+#endif // BINLOGWRITER_H
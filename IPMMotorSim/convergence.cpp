@@ -0,0 +1,98 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "convergence.h"
+#include <QVector>
+
+#define REF_SUBSTEPS 64 //reference steps per base timestep
+static const int stepMultipliers[] = {1, 2, 5, 10};
+static const char *integratorNames[] = {"euler", "semi-implicit", "rk4", "exact"};
+
+//apply dq voltages at the current rotor angle, inverse of the park/clarke transform in MotorModel::Step
+static void stepOpenLoop(MotorModel *motor, double Vd, double Vq)
+{
+    double angle = qDegreesToRadians(motor->getElecPosition());
+    double Valpha = (Vd * qCos(angle)) - (Vq * qSin(angle));
+    double Vbeta = (Vd * qSin(angle)) + (Vq * qCos(angle));
+    double Va = Valpha;
+    double Vb = (-Valpha + (qSqrt(3.0) * Vbeta)) / 2.0;
+    double Vc = (-Valpha - (qSqrt(3.0) * Vbeta)) / 2.0;
+    motor->Step(Va, Vb, Vc);
+}
+
+static MotorModel *createMotor(Scenario &scenario, int integrator, double timestep)
+{
+    MotorModel *motor = scenario.CreateMotor();
+    motor->setIntegrator(integrator);
+    motor->setTimestep(timestep);
+    motor->setSyncDelay(0); //angle used for the voltages must be the model angle
+    return motor;
+}
+
+void ConvergenceReport(Scenario &scenario, double duration, QTextStream &out)
+{
+    double Vd = scenario.getValue("ConvVd");
+    double Vq = scenario.getValue("ConvVq");
+    double timestep = 1.0 / scenario.getValue("LoopFreq");
+    int baseSteps = int(duration / timestep);
+
+    //reference currents at every base timestep
+    QVector<double> refId(baseSteps + 1), refIq(baseSteps + 1), refRpm(baseSteps + 1);
+    MotorModel *ref = createMotor(scenario, INTEG_RK4, timestep / REF_SUBSTEPS);
+    refId[0] = ref->getId();
+    refIq[0] = ref->getIq();
+    refRpm[0] = ref->getMotorFreq() * 60;
+    for(int i = 1; i <= baseSteps; i++)
+    {
+        for(int j = 0; j < REF_SUBSTEPS; j++)
+            stepOpenLoop(ref, Vd, Vq);
+        refId[i] = ref->getId();
+        refIq[i] = ref->getIq();
+        refRpm[i] = ref->getMotorFreq() * 60;
+    }
+    delete ref;
+
+    out << "Convergence against RK4 at " << (timestep * 1e6 / REF_SUBSTEPS) << "us, " << duration << "s, Vd=" << Vd << " Vq=" << Vq << "\n";
+    out << "integrator,step_us,steps,max_err_A,rms_err_A,rpm_err\n";
+    for(int integrator = INTEG_EULER; integrator <= INTEG_EXACT; integrator++)
+    {
+        for(int mult : stepMultipliers)
+        {
+            int steps = baseSteps / mult;
+            if(steps < 1)
+                continue;
+
+            MotorModel *motor = createMotor(scenario, integrator, timestep * mult);
+            double maxErr = 0, sumSq = 0;
+            for(int k = 1; k <= steps; k++)
+            {
+                stepOpenLoop(motor, Vd, Vq);
+                double errd = motor->getId() - refId[k * mult];
+                double errq = motor->getIq() - refIq[k * mult];
+                double err = qSqrt((errd * errd) + (errq * errq));
+                if(qIsNaN(err) || err > maxErr)
+                    maxErr = err;
+                sumSq += err * err;
+            }
+            out << integratorNames[integrator] << ',' << (timestep * mult * 1e6) << ',' << steps << ','
+                << maxErr << ',' << qSqrt(sumSq / steps) << ',' << (motor->getMotorFreq() * 60 - refRpm[steps * mult]) << "\n"; //same time, mult needn't divide baseSteps
+            delete motor;
+        }
+    }
+}
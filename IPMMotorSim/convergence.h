@@ -0,0 +1,30 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONVERGENCE_H
+#define CONVERGENCE_H
+
+#include <QTextStream>
+#include "scenario.h"
+
+//Compares each motor model integrator against a fine step RK4 reference
+//The motor is driven open loop with fixed dq voltages (ConvVd/ConvVq) so the firmware is not involved
+void ConvergenceReport(Scenario &scenario, double duration, QTextStream &out);
+
+#endif // CONVERGENCE_H
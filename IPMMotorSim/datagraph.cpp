@@ -23,19 +23,18 @@
 #include <QtCharts/QChart>
 #include <QtCharts/QChartView>
 #include <QSettings>
+#include <QStackedWidget>
 #include <limits>
 
+#define DECIMATE_MIN_COLUMNS 800 //used before the chart has been laid out
+
 DataGraph::DataGraph(QString name, QWidget *parent) : QMainWindow(parent)
 {
     mName = name;
     QSettings settings("OpenInverter", "IPMMotorSim");
 
-    minY_L =  std::numeric_limits<double>::max();
-    maxY_L =  std::numeric_limits<double>::lowest();
-    minY_R =  std::numeric_limits<double>::max();
-    maxY_R =  std::numeric_limits<double>::lowest();
-    minX =  std::numeric_limits<double>::max();
-    maxX =  std::numeric_limits<double>::lowest();
+    resetRanges();
+    m_scrollWidth = 0;
 
     m_chart = new Chart();
     m_chart->legend()->show();
@@ -49,8 +48,15 @@ DataGraph::DataGraph(QString name, QWidget *parent) : QMainWindow(parent)
     m_chart->addAxis(m_axisX, Qt::AlignBottom);
     m_chart->addAxis(m_axisL, Qt::AlignLeft);
     m_chart->addAxis(m_axisR, Qt::AlignRight);
+    m_updating = false;
+    connect(m_axisX, &QValueAxis::rangeChanged, this, &DataGraph::xRangeChanged); //zoom and pan
 
-    setCentralWidget(m_chartView);
+    m_plot = new PlotWidget();
+    m_fastPlot = false;
+    m_stack = new QStackedWidget();
+    m_stack->addWidget(m_chartView);
+    m_stack->addWidget(m_plot);
+    setCentralWidget(m_stack);
     if(!restoreGeometry(settings.value(mName + "/geometry").toByteArray()) || !restoreState(settings.value(mName + "/windowState").toByteArray()))
     {
         resize(1600, 300);
@@ -65,6 +71,35 @@ void DataGraph::setAxisText(QString x, QString left, QString right)
     m_axisX->setTitleText(x);
     m_axisL->setTitleText(left);
     m_axisR->setTitleText(right);
+    m_plot->setAxisText(x, left, right);
+}
+
+void DataGraph::setFastPlot(bool fast)
+{
+    if(fast == m_fastPlot)
+        return;
+
+    m_fastPlot = fast;
+    if(fast)
+        m_stack->setCurrentWidget(m_plot);
+    else
+    {
+        //bound series weren't kept up to date while hidden, empty ones are reloaded by updateGraph()
+        QMap<int, SeriesBinding>::iterator b;
+        for (b = m_bindings.begin(); b != m_bindings.end(); ++b)
+        {
+            if(m_lineSeries.contains(b.key()))
+                m_lineSeries[b.key()]->clear();
+        }
+        m_plot->setTraces(QVector<PlotTrace>());
+        m_stack->setCurrentWidget(m_chartView);
+    }
+    updateGraph();
+}
+
+void DataGraph::setScrollWidth(double width)
+{
+    m_scrollWidth = width;
 }
 
 void DataGraph::saveWinState()
@@ -81,6 +116,7 @@ void DataGraph::saveWinState()
 
 DataGraph::~DataGraph()
 {
+    m_bindings.clear(); //recorder may already have gone
     clearData();
 }
 
@@ -154,57 +190,317 @@ void DataGraph::addDataPoints(QList<QPointF> pointList, int key)
     }
 }
 
-void DataGraph::updateGraph(void)
+//the circle on the IdIq graph is redrawn every update, appending would grow the list without end
+void DataGraph::setDataPoints(QList<QPointF> pointList, int key)
 {
-    m_chart->removeAllSeries();
+    if(!m_series.contains(key))
+        return;
 
-    QMap<int, QList<QPointF> *>::iterator i;
-    for (i = m_series.begin(); i != m_series.end(); ++i)
+    m_series[key]->clear();
+    if(m_lineSeries.contains(key))
     {
-        QLineSeries *series = new QLineSeries(); //chart will take ownership of this and delete when done
-        series->append(*i.value());
+        m_lineSeries[key]->clear();
+        m_pushed[key] = 0;
+    }
+    addDataPoints(pointList, key);
+}
+
+void DataGraph::bindSeries(int key, const TraceRecorder *recorder, int yChannel, int xChannel)
+{
+    if(!m_series.contains(key))
+        return;
+
+    SeriesBinding binding;
+    binding.recorder = recorder;
+    binding.xChannel = xChannel;
+    binding.yChannel = yChannel;
+    binding.start = recorder->count();
+    binding.scanned = binding.start;
+    binding.discarded = recorder->discarded();
+    binding.fetchedMin = qQNaN(); //nothing fetched yet
+    binding.fetchedMax = qQNaN();
+    binding.fetchedRows = 0;
+    binding.generation = recorder->generation();
+    if(xChannel == TR_TIME)
+        binding.pyramid.Update(recorder->column(yChannel), recorder->rows(yChannel));
+    m_bindings[key] = binding;
+}
+
+//recorder channels the bound series read
+ChannelMask DataGraph::channels(void) const
+{
+    ChannelMask mask = 0;
+    QMap<int, SeriesBinding>::const_iterator b;
+    for (b = m_bindings.constBegin(); b != m_bindings.constEnd(); ++b)
+    {
+        mask |= TR_CHANNEL(b.value().yChannel);
+        if(b.value().xChannel != TR_TIME)
+            mask |= TR_CHANNEL(b.value().xChannel);
+    }
+    return mask;
+}
+
+void DataGraph::resetRanges(void)
+{
+    minY_L =  std::numeric_limits<double>::max();
+    maxY_L =  std::numeric_limits<double>::lowest();
+    minY_R =  std::numeric_limits<double>::max();
+    maxY_R =  std::numeric_limits<double>::lowest();
+    minX =  std::numeric_limits<double>::max();
+    maxX =  std::numeric_limits<double>::lowest();
+}
+
+//a recorder with a history limit drops its oldest rows and moves the rest down
+//bindings follow the rows they were showing and the ranges are rebuilt from what is left
+void DataGraph::rebaseBindings(void)
+{
+    bool moved = false;
+    QMap<int, SeriesBinding>::iterator b;
+    for (b = m_bindings.begin(); b != m_bindings.end(); ++b)
+    {
+        SeriesBinding &binding = b.value();
+        qint64 dropped = binding.recorder->discarded() - binding.discarded;
+        if(dropped == 0)
+            continue;
+        binding.start = int(qMax(qint64(0), binding.start - dropped));
+        binding.scanned = binding.start;
+        binding.discarded = binding.recorder->discarded();
+        binding.pyramid.Clear();
+        moved = true;
+    }
+    if(moved)
+        resetRanges();
+}
+
+double DataGraph::scrollMinX(void)
+{
+    if(m_scrollWidth > 0)
+        return qMax(minX, maxX - m_scrollWidth);
+    return minX;
+}
+
+//extend the axis ranges with any rows recorded since the last scan
+void DataGraph::scanBinding(SeriesBinding &binding, axisSel axis)
+{
+    int count = binding.recorder->count();
+    if(binding.recorder->generation() != binding.generation) //cleared or truncated back to a branch point, rows past the cut may have been recorded again since
+    {
+        if(binding.start > count)
+            binding.start = 0;
+        binding.scanned = binding.start; //range is only widened, the rows are scanned again
+        binding.fetchedRows = -1;
+        binding.pyramid.Clear();
+        binding.generation = binding.recorder->generation();
+    }
+
+    double &minY = (axis == left) ? minY_L : minY_R;
+    double &maxY = (axis == left) ? maxY_L : maxY_R;
+    binding.recorder->range(binding.xChannel, binding.scanned, count, minX, maxX); //time comes from the segment ends
+    binding.recorder->range(binding.yChannel, binding.scanned, count, minY, maxY); //rows of disabled channels are NaN and skipped
+    binding.scanned = count;
+    if(binding.xChannel == TR_TIME)
+        binding.pyramid.Update(binding.recorder->column(binding.yChannel), binding.recorder->rows(binding.yChannel));
+}
+
+//rows in the visible x range (only time is known to be in order), at most a min and max point per pixel column from the pyramid
+//y extremes alone would change the shape of an x/y trajectory, so those get every row
+QVector<QPointF> DataGraph::boundPoints(const SeriesBinding &binding, int columns, double xMin, double xMax)
+{
+    const TraceRecorder *recorder = binding.recorder;
+    int first = binding.start;
+    int last = recorder->count();
+    if(binding.xChannel == TR_TIME)
+        recorder->timeRows(xMin, xMax, first, last);
+
+    QVector<int> rows;
+    if(binding.xChannel == TR_TIME)
+        binding.pyramid.Query(recorder->column(binding.yChannel), first, last, columns, rows);
+    else
+    {
+        last = qMin(last, recorder->rows(binding.yChannel));
+        for(int i = first; i < last; i++)
+            rows.append(i);
+    }
+
+    QVector<QPointF> points;
+    points.reserve(rows.size());
+    for(int i = 0; i < rows.size(); i++)
+    {
+        double x = recorder->value(binding.xChannel, rows[i]);
+        if(!qIsNaN(x))
+            points.append(QPointF(x, recorder->value(binding.yChannel, rows[i])));
+    }
+    return points;
+}
+
+int DataGraph::plotColumns(void)
+{
+    return qMax(int(m_chart->plotArea().width()), DECIMATE_MIN_COLUMNS);
+}
+
+//reload the bound series at the resolution of the new x range
+void DataGraph::xRangeChanged(qreal min, qreal max)
+{
+    if(m_updating)
+        return;
+
+    int columns = plotColumns();
+    QMap<int, SeriesBinding>::iterator b;
+    for (b = m_bindings.begin(); b != m_bindings.end(); ++b)
+    {
+        if(m_lineSeries.contains(b.key()))
+        {
+            m_lineSeries[b.key()]->replace(boundPoints(b.value(), columns, min, max));
+            b.value().fetchedMin = min;
+            b.value().fetchedMax = max;
+            b.value().fetchedRows = b.value().scanned;
+        }
+    }
+}
+
+//line series for a key, created and attached on first use then kept so updates only push what changed
+QLineSeries *DataGraph::lineSeries(int key)
+{
+    QLineSeries *series = m_lineSeries.value(key, nullptr);
+    if(!series)
+    {
+        series = new QLineSeries(); //chart will take ownership of this and delete when done
         m_chart->addSeries(series);
-        series->setName(m_legends[i.key()]);
-        if(m_colours.contains(i.key())) //if we have a colour then override standard one
-            series->setColor(m_colours[i.key()]);
-        if(m_opacity.contains(i.key())) //if we have an opacity then override standard one
-            series->setOpacity(m_opacity[i.key()]);
         series->attachAxis(m_axisX);
-        if(m_axis[i.key()] == left)
-            series->attachAxis(m_axisL);
+        m_lineSeries[key] = series;
+        m_pushed[key] = 0;
+    }
+    else if(m_attached[key] != m_axis[key])
+        series->detachAxis(m_attached[key] == left ? m_axisL : m_axisR);
+
+    if(!m_attached.contains(key) || m_attached[key] != m_axis[key])
+    {
+        series->attachAxis(m_axis[key] == left ? m_axisL : m_axisR);
+        m_attached[key] = m_axis[key];
+    }
+    if(series->name() != m_legends[key])
+        series->setName(m_legends[key]);
+    if(m_colours.contains(key) && series->color() != m_colours[key]) //if we have a colour then override standard one
+        series->setColor(m_colours[key]);
+    if(m_opacity.contains(key) && series->opacity() != m_opacity[key]) //if we have an opacity then override standard one
+        series->setOpacity(m_opacity[key]);
+    return series;
+}
+
+//hand the series to the plot widget, it reads the points itself when it paints
+void DataGraph::updatePlot(void)
+{
+    rebaseBindings();
+    QVector<PlotTrace> traces;
+    QMap<int, QList<QPointF> *>::iterator i;
+    for (i = m_series.begin(); i != m_series.end(); ++i)
+    {
+        PlotTrace trace;
+        trace.name = m_legends[i.key()];
+        trace.colour = m_colours.value(i.key());
+        trace.opacity = m_opacity.value(i.key(), 1.0);
+        trace.rightAxis = (m_axis[i.key()] == right);
+        trace.points = nullptr;
+        trace.recorder = nullptr;
+        trace.pyramid = nullptr;
+        if(m_bindings.contains(i.key()))
+        {
+            SeriesBinding &binding = m_bindings[i.key()];
+            scanBinding(binding, m_axis[i.key()]);
+            trace.recorder = binding.recorder;
+            trace.xChannel = binding.xChannel;
+            trace.yChannel = binding.yChannel;
+            trace.first = binding.start;
+            trace.last = binding.recorder->count();
+            if(binding.xChannel == TR_TIME)
+                trace.pyramid = &binding.pyramid;
+        }
         else
-            series->attachAxis(m_axisR);
+            trace.points = i.value();
+        traces.append(trace);
+    }
+    m_plot->setTraces(traces);
+    m_plot->setRanges(scrollMinX(), maxX, minY_L, maxY_L, minY_R, maxY_R);
+}
+
+void DataGraph::updateGraph(void)
+{
+    if(m_fastPlot)
+    {
+        updatePlot();
+        return;
     }
 
-    m_axisX->setRange(minX, maxX);
+    m_updating = true;
+    int columns = plotColumns();
+    rebaseBindings();
+    QMap<int, SeriesBinding>::iterator b;
+    for (b = m_bindings.begin(); b != m_bindings.end(); ++b)
+        scanBinding(b.value(), m_axis[b.key()]);
+    double xMin = scrollMinX(); //axis range is reset to everything recorded, zoomed series are fetched again to match
+    double xMax = maxX;
+
+    QMap<int, QList<QPointF> *>::iterator i;
+    for (i = m_series.begin(); i != m_series.end(); ++i)
+    {
+        QLineSeries *series = lineSeries(i.key());
+        if(m_bindings.contains(i.key()))
+        {
+            SeriesBinding &binding = m_bindings[i.key()];
+            if(binding.fetchedRows != binding.scanned || binding.fetchedMin != xMin || binding.fetchedMax != xMax || series->count() == 0)
+            {
+                series->replace(boundPoints(binding, columns, xMin, xMax));
+                binding.fetchedMin = xMin;
+                binding.fetchedMax = xMax;
+                binding.fetchedRows = binding.scanned;
+            }
+        }
+        else if(m_pushed[i.key()] < i.value()->size())
+        {
+            series->append(i.value()->mid(m_pushed[i.key()])); //only the points added since the last update
+            m_pushed[i.key()] = i.value()->size();
+        }
+    }
+
+    m_axisX->setRange(xMin, xMax);
     m_axisL->setRange(minY_L, maxY_L);
     m_axisR->setRange(minY_R, maxY_R);
+    m_updating = false;
 }
 
 void DataGraph::updateXaxis(double min, double max)
 {
     m_axisX->setRange(min, max);
+    m_plot->setXRange(min, max);
 }
 
 void DataGraph::updateLeftYaxis(double min, double max)
 {
     m_axisL->setRange(min, max);
+    m_plot->setLeftRange(min, max);
 }
 
 void DataGraph::clearData(void)
 {
-    minY_L =  std::numeric_limits<double>::max();
-    maxY_L =  std::numeric_limits<double>::lowest();
-    minY_R =  std::numeric_limits<double>::max();
-    maxY_R =  std::numeric_limits<double>::lowest();
-    minX =  std::numeric_limits<double>::max();
-    maxX =  std::numeric_limits<double>::lowest();
-    m_chart->removeAllSeries();
+    resetRanges();
+    m_plot->setTraces(QVector<PlotTrace>());
+    QMap<int, QLineSeries *>::iterator l;
+    for (l = m_lineSeries.begin(); l != m_lineSeries.end(); ++l)
+    {
+        l.value()->clear();
+        m_pushed[l.key()] = 0;
+    }
     QMap<int, QList<QPointF> *>::iterator i;
     for (i = m_series.begin(); i != m_series.end(); ++i)
     {
         i.value()->clear();
     }
+    QMap<int, SeriesBinding>::iterator b;
+    for (b = m_bindings.begin(); b != m_bindings.end(); ++b)
+    {
+        b.value().start = b.value().recorder->count();
+        b.value().scanned = b.value().start;
+    }
 }
 
 void DataGraph::setColour(QColor colour, int key)
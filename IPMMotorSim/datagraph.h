@@ -25,9 +25,29 @@
 #include <QtCharts/QValueAxis>
 #include "chartview.h"
 #include "chart.h"
+#include "tracerecorder.h"
+#include "minmaxpyramid.h"
+#include "plotwidget.h"
+
+class QStackedWidget;
 
 enum axisSel {left,right};
 
+//series that reads its points straight from the recorder columns rather than keeping a copy
+struct SeriesBinding
+{
+    const TraceRecorder *recorder;
+    int xChannel;
+    int yChannel;
+    int start; //first row shown, moved on by clearData()
+    int scanned; //rows already included in the axis ranges
+    int generation; //recorder->generation() the pyramid and scanned rows belong to
+    qint64 discarded; //recorder->discarded() when the row numbers above were last moved down to match
+    double fetchedMin, fetchedMax; //x range the line series points were decimated for
+    int fetchedRows; //scanned when they were
+    MinMaxPyramid pyramid; //y column at several resolutions for zooming, time bindings only
+};
+
 class DataGraph : public QMainWindow
 {
     Q_OBJECT
@@ -39,6 +59,9 @@ public:
     void updateSeries(QString legend, axisSel axis, int key);
     void addDataPoint(double x, double y, int key);
     void addDataPoints(QList<QPointF> pointList, int key);
+    void setDataPoints(QList<QPointF> pointList, int key); //replaces the series points
+    void bindSeries(int key, const TraceRecorder *recorder, int yChannel, int xChannel = TR_TIME);
+    ChannelMask channels(void) const;
     void clearData();
     void updateGraph(void);
     void updateXaxis(double min, double max);
@@ -46,15 +69,26 @@ public:
     void setColour(QColor colour, int key);
     void setOpacity(qreal opacity, int key);
     void setAxisText(QString x, QString left, QString right);
+    void setFastPlot(bool fast); //draw with PlotWidget rather than QtCharts
+    void setScrollWidth(double width); //show only the latest width of the x axis, 0 shows it all
 
 private:
     Chart *m_chart;
     ChartView *m_chartView;
+    PlotWidget *m_plot;
+    QStackedWidget *m_stack;
+    bool m_fastPlot;
     QMap<int, QList<QPointF> *> m_series;
     QMap<int, QString> m_legends;
     QMap<int, QColor> m_colours;
     QMap<int, qreal> m_opacity;
     QMap<int, axisSel> m_axis;
+    QMap<int, SeriesBinding> m_bindings;
+    QMap<int, QLineSeries *> m_lineSeries; //owned by the chart, kept for the life of the graph
+    QMap<int, int> m_pushed; //points of each unbound series already in its line series
+    QMap<int, axisSel> m_attached; //y axis each line series is attached to
+    bool m_updating;
+    double m_scrollWidth;
 
     double minX, maxX, minY_L, maxY_L, minY_R, maxY_R;
     QString mName;
@@ -63,10 +97,21 @@ private:
     QValueAxis *m_axisR;
     QValueAxis *m_axisX;
 
+    void resetRanges(void);
+    void rebaseBindings(void);
+    double scrollMinX(void);
+    void scanBinding(SeriesBinding &binding, axisSel axis);
+    QVector<QPointF> boundPoints(const SeriesBinding &binding, int columns, double xMin, double xMax);
+    int plotColumns(void);
+    QLineSeries *lineSeries(int key);
+    void updatePlot(void);
 
 signals:
 
 public slots:
+
+private slots:
+    void xRangeChanged(qreal min, qreal max);
 };
 
 #endif // DATAGRAPH_H
@@ -0,0 +1,127 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "efficiencymap.h"
+#include <QSettings>
+#include <QtMath>
+#include "tracerecorder.h"
+
+#define MAP_MEASURE_PERIODS 4 //electrical periods averaged once steady
+#define MAP_MEASURE_MAX 0.1 //s, measuring time at low speed
+#define MAP_MEASURE_MIN 0.01 //s, measuring time at high speed
+
+EfficiencyMap::EfficiencyMap()
+    :m_duration{2}
+{
+}
+
+bool EfficiencyMap::Load(const QString &fileName, const Scenario &base)
+{
+    if(!ReadFile(fileName, base))
+        return false;
+
+    QSettings settings(fileName, QSettings::IniFormat);
+    settings.beginGroup("Map");
+    SweepAxis speed, torque;
+    if(!settings.contains("speed") || !settings.contains("torque"))
+    {
+        m_error = "[Map] needs speed and torque ranges in " + fileName;
+        return false;
+    }
+    if(!ParseAxis("speed_rpm", settings.value("speed").toStringList(), speed) ||
+       !ParseAxis("torque_demand", settings.value("torque").toStringList(), torque))
+        return false;
+    m_duration = settings.value("duration", 2.0).toDouble();
+    settings.endGroup();
+
+    m_axes.append(speed);
+    m_axes.append(torque);
+    m_numPoints = speed.values.size() * torque.values.size();
+    return true;
+}
+
+QStringList EfficiencyMap::MetricNames(void)
+{
+    return QStringList() << "steady" << "settle_time" << "rpm" << "torque" << "mech_power" << "elec_power" << "efficiency"
+                         << "iq" << "id" << "voltage_margin";
+}
+
+void EfficiencyMap::RunPoint(int index, double *metrics)
+{
+    double values[2];
+    PointValues(index, values);
+
+    //the warm start state is shared by every point so comes from the cache after the first
+    Scenario point = PointScenario(index);
+    SimEngine *engine = point.StartEngine();
+    engine->getMotor()->setDyno(true);
+    engine->getMotor()->setDynoSpeed(values[0]);
+    engine->setTorqueDemand(values[1]);
+
+    SteadyStateDetector detector = point.getSteadyDetector();
+    if(!point.isSteadyEnabled()) //currents and controller outputs, the dyno holds the speed
+    {
+        for(int ch = 0; ch < SS_COUNT; ch++)
+            detector.setEnabled(ch, ch != SS_SPEED);
+    }
+    detector.Reset();
+    double start = engine->getTime();
+    engine->RunUntilSteady(int(m_duration / engine->getTimestep()), &detector);
+    double settleTime = engine->getTime() - start;
+
+    double elecFreq = qAbs(values[0] / 60.0) * engine->getMotor()->getPoles();
+    double window = (elecFreq > 0) ? qBound(MAP_MEASURE_MIN, MAP_MEASURE_PERIODS / elecFreq, MAP_MEASURE_MAX) : MAP_MEASURE_MAX;
+    TraceRecorder recorder;
+    int channels[] = {TR_SHAFT_RPM, TR_TORQUE, TR_POWER, TR_ELEC_POWER, TR_IQ, TR_ID, TR_VD, TR_VQ};
+    ChannelMask mask = 0;
+    for(int ch : channels)
+        mask |= TR_CHANNEL(ch);
+    recorder.subscribe(this, mask);
+    engine->RunFor(qMax(int(window / engine->getTimestep()), 1), &recorder);
+
+    int n = recorder.count();
+    double sum[TR_COUNT] = {0};
+    double sumV = 0;
+    for(int i = 0; i < n; i++)
+    {
+        for(int ch : channels)
+            sum[ch] += recorder.value(ch, i);
+        sumV += qSqrt((recorder.value(TR_VD, i) * recorder.value(TR_VD, i)) + (recorder.value(TR_VQ, i) * recorder.value(TR_VQ, i)));
+    }
+
+    double mech = sum[TR_POWER] / n;
+    double elec = sum[TR_ELEC_POWER] / n;
+    double vmax = engine->getVdc() / qSqrt(3.0); //linear modulation limit with SVM
+    metrics[0] = detector.isSteady() ? 1 : 0;
+    metrics[1] = settleTime;
+    metrics[2] = sum[TR_SHAFT_RPM] / n;
+    metrics[3] = sum[TR_TORQUE] / n;
+    metrics[4] = mech;
+    metrics[5] = elec;
+    //motoring is mechanical out over electrical in, generating the other way round
+    if(mech >= 0)
+        metrics[6] = (elec > 0) ? (100.0 * mech / elec) : 0;
+    else
+        metrics[6] = (elec < 0) ? (100.0 * elec / mech) : 0;
+    metrics[7] = sum[TR_IQ] / n;
+    metrics[8] = sum[TR_ID] / n;
+    metrics[9] = 100.0 * (1.0 - ((sumV / n) / vmax));
+    delete engine;
+}
@@ -0,0 +1,46 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef EFFICIENCYMAP_H
+#define EFFICIENCYMAP_H
+
+#include "sweep.h"
+
+//Torque-speed operating point map from the [Map] group of a scenario file
+//  speed=0:500:8000      shaft rpm
+//  torque=10:10:100      torque demand %
+//  duration=2            longest time allowed for a point to settle (s)
+//Each point starts from the scenario's warm start state with the dyno holding the given speed and runs until steady,
+//the results are the means over the following electrical periods
+class EfficiencyMap : public Sweep
+{
+public:
+    EfficiencyMap();
+    bool Load(const QString &fileName, const Scenario &base) override;
+
+protected:
+    QStringList MetricNames(void) override;
+    void RunPoint(int index, double *metrics) override;
+
+private:
+    double m_duration;
+};
+
+#endif // EFFICIENCYMAP_H
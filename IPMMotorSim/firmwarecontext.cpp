@@ -0,0 +1,52 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "firmwarecontext.h"
+
+#ifdef SIM_FWSTATE_REGION
+//bounds of the firmware/test stub data, placed by fwstate.ld
+extern "C" char __fwstate_start[], __fwstate_end[];
+#endif
+
+bool FirmwareContext::isSupported(void)
+{
+#ifdef SIM_FWSTATE_REGION
+    return true;
+#else
+    return false;
+#endif
+}
+
+int FirmwareContext::stateSize(void)
+{
+#ifdef SIM_FWSTATE_REGION
+    return int(__fwstate_end - __fwstate_start);
+#else
+    return 0;
+#endif
+}
+
+char *FirmwareContext::stateData(void)
+{
+#ifdef SIM_FWSTATE_REGION
+    return __fwstate_start;
+#else
+    return nullptr;
+#endif
+}
@@ -0,0 +1,34 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FIRMWARECONTEXT_H
+#define FIRMWARECONTEXT_H
+
+//The stm32-sine firmware and the test stubs keep all of their state in globals, one set per process
+//fwstate.ld (SIM_FWSTATE_REGION) gathers them into one region so the whole state can be saved and put back with a memory copy
+//Used by SimEngine::Snapshot()/Restore() and the warm start cache
+class FirmwareContext
+{
+public:
+    static bool isSupported(void);
+    static int stateSize(void);
+    static char *stateData(void); //live firmware globals
+};
+
+#endif // FIRMWARECONTEXT_H
@@ -0,0 +1,164 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "flightrecorder.h"
+#include <QFile>
+#include <QTextStream>
+#include <QStringList>
+#include <QtMath>
+#include <string.h>
+
+static const char *channelNames[FR_COUNT] =
+{
+    "Ia", "Ib", "Ic", "Iq", "Id", "Vd", "Vq", "elec_pos", "rpm", "torque",
+    "cont_iq", "cont_id", "cont_ud", "cont_uq", "cont_ifw", "duty_a", "duty_b", "duty_c", "pwm_off", "demand"
+};
+
+FlightRecorder::FlightRecorder()
+    :m_seconds{0}, m_rows{0}, m_head{0}, m_count{0}, m_time{0}, m_timestep{0}, m_pwmOff{false}, m_armed{true}, m_dumps{0}
+{
+}
+
+const char *FlightRecorder::channelName(int channel)
+{
+    return channelNames[channel];
+}
+
+int FlightRecorder::channelIndex(const char *name)
+{
+    for(int ch = 0; ch < FR_COUNT; ch++)
+    {
+        if(strcmp(name, channelNames[ch]) == 0)
+            return ch;
+    }
+    return -1;
+}
+
+//comma separated name>level, the assertion fails as the size of the value goes above level
+bool FlightRecorder::ParseAssertions(const QString &spec)
+{
+    m_assertions.clear();
+    for(const QString &item : spec.split(','))
+    {
+        QString text = item.trimmed();
+        if(text.isEmpty())
+            continue;
+        int op = text.indexOf('>');
+        bool ok = false;
+        double level = (op > 0) ? text.mid(op + 1).trimmed().toDouble(&ok) : 0;
+        int ch = (op > 0) ? channelIndex(text.left(op).trimmed().toLatin1().constData()) : -1;
+        if(!ok || ch < 0)
+        {
+            m_error = "Invalid flight recorder assertion: " + text;
+            m_assertions.clear();
+            return false;
+        }
+        m_assertions.append({ch, level});
+    }
+    return true;
+}
+
+void FlightRecorder::Reset(double timestep)
+{
+    m_timestep = timestep;
+    m_rows = (m_seconds > 0) ? qMax(1, int(m_seconds / timestep)) : 0;
+    m_ring.resize(m_rows * FR_COUNT);
+    m_ring.squeeze();
+    m_head = 0;
+    m_count = 0;
+    m_pwmOff = false;
+    m_armed = true;
+    m_above.clear();
+    for(int i = 0; i < m_assertions.size(); i++)
+        m_above.append(false);
+}
+
+//once per step, a plain copy unless something is wrong
+void FlightRecorder::Sample(double time, const float *values)
+{
+    memcpy(&m_ring[m_head * FR_COUNT], values, FR_COUNT * sizeof(float));
+    m_head = (m_head + 1 == m_rows) ? 0 : m_head + 1;
+    m_count = qMin(m_count + 1, m_rows);
+    m_time = time;
+
+    float sum = 0;
+    for(int ch = 0; ch < FR_MOTOR_END; ch++)
+        sum += values[ch]; //NaN or Inf in any of them carries through
+    bool pwmOff = values[FR_PWM_OFF] != 0;
+    bool tripped = pwmOff && !m_pwmOff && m_count > 1;
+    m_pwmOff = pwmOff;
+    if(!qIsFinite(sum))
+        Fault("NaN/Inf in the motor model");
+    else if(tripped)
+        Fault("PWM disabled");
+
+    for(int i = 0; i < m_assertions.size(); i++)
+    {
+        bool above = qAbs(values[m_assertions[i].channel]) > m_assertions[i].level;
+        if(above && !m_above[i])
+            Fault(QString("Assertion failed: %1>%2").arg(channelNames[m_assertions[i].channel]).arg(m_assertions[i].level));
+        m_above[i] = above;
+    }
+}
+
+//only the first fault is written, whatever follows it is usually a consequence
+void FlightRecorder::Fault(const QString &reason)
+{
+    if(!m_armed || m_rows == 0)
+        return;
+    m_armed = false;
+    m_reasonLock.lock();
+    m_reason = reason;
+    m_reasonLock.unlock();
+    Dump();
+    m_dumps++;
+}
+
+QString FlightRecorder::getFaultReason(void) const
+{
+    QMutexLocker locker(&m_reasonLock);
+    return m_reason;
+}
+
+bool FlightRecorder::Dump(void)
+{
+    QFile file(m_dumpFile);
+    if(m_dumpFile.isEmpty() || !file.open(QFile::WriteOnly | QFile::Text))
+        return false;
+
+    QTextStream out(&file);
+    out.setRealNumberPrecision(8);
+    out << "# " << m_reason << '\n';
+    out << "time";
+    for(int ch = 0; ch < FR_COUNT; ch++)
+        out << ',' << channelNames[ch];
+    out << '\n';
+
+    int first = (m_head - m_count + m_rows) % m_rows; //oldest row
+    for(int i = 0; i < m_count; i++)
+    {
+        const float *row = &m_ring[((first + i) % m_rows) * FR_COUNT];
+        out << m_time - ((m_count - 1 - i) * m_timestep);
+        for(int ch = 0; ch < FR_COUNT; ch++)
+            out << ',' << row[ch];
+        out << '\n';
+    }
+    return true;
+}
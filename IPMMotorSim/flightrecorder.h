@@ -0,0 +1,104 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FLIGHTRECORDER_H
+#define FLIGHTRECORDER_H
+
+#include <QString>
+#include <QVector>
+#include <QList>
+#include <QMutex>
+#include <atomic>
+
+enum FlightChannel
+{
+    FR_IA = 0, //motor model
+    FR_IB,
+    FR_IC,
+    FR_IQ,
+    FR_ID,
+    FR_VD,
+    FR_VQ,
+    FR_ELEC_POS,
+    FR_RPM,
+    FR_TORQUE,
+    FR_MOTOR_END, //channels up to here are checked for NaN/Inf
+    FR_CONT_IQ = FR_MOTOR_END, //controller Params
+    FR_CONT_ID,
+    FR_CONT_UD,
+    FR_CONT_UQ,
+    FR_CONT_IFW,
+    FR_DUTY_A, //FOC duty cycles
+    FR_DUTY_B,
+    FR_DUTY_C,
+    FR_PWM_OFF, //1 while the firmware has PWM disabled
+    FR_DEMAND, //torque demand %
+    FR_COUNT
+};
+
+//fires as |value| rises above level
+struct FlightAssertion
+{
+    int channel;
+    double level;
+};
+
+//Always on ring of the last few seconds of every internal channel, stored as float with an implicit time axis
+//Written to a CSV file on the first fault since the last reset: PWM being disabled, NaN/Inf in the motor model or a failed assertion
+class FlightRecorder
+{
+public:
+    FlightRecorder();
+    void setLength(double seconds) {m_seconds = seconds;} //0 turns it off, takes effect at Reset()
+    void setDumpFile(const QString &fileName) {m_dumpFile = fileName;}
+    QString getDumpFile(void) {return m_dumpFile;}
+    bool ParseAssertions(const QString &spec); //e.g. "Iq>400, rpm>12000"
+    QString getError(void) {return m_error;}
+    void Reset(double timestep); //empties the ring and re-arms the dump
+    bool isEnabled(void) const {return m_rows > 0;}
+    void Sample(double time, const float *values);
+    void Fault(const QString &reason); //for assertions made in code
+    int getDumps(void) const {return m_dumps;} //can be polled from another thread
+    QString getFaultReason(void) const; //can be read from another thread
+    static const char *channelName(int channel);
+    static int channelIndex(const char *name);
+
+private:
+    bool Dump(void);
+
+    double m_seconds;
+    QString m_dumpFile;
+    QList<FlightAssertion> m_assertions;
+    QList<bool> m_above;
+    QVector<float> m_ring; //m_rows rows of FR_COUNT values
+    int m_rows;
+    int m_head; //next row to write
+    int m_count; //rows held
+    double m_time; //of the newest row
+    double m_timestep;
+    bool m_pwmOff;
+    bool m_armed;
+    std::atomic<int> m_dumps;
+    mutable QMutex m_reasonLock; //the recording thread sets the reason while the GUI may be reading it
+    QString m_reason;
+    QString m_error;
+};
+
+#endif // FLIGHTRECORDER_H
@@ -49,7 +49,7 @@ void IdIqGraph::updateGraph(bool isAmps)
         q = s * qSin(qDegreesToRadians(ang));
         list.append(QPointF(d, q));
     }
-    addDataPoints(list, 10);
+    setDataPoints(list, 10);
 
     DataGraph::updateGraph();
 
@@ -20,20 +20,16 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include <QtMath>
-#include <QRandomGenerator>
 #include <QSettings>
+#include <QDataStream>
+#include <QFileDialog>
+#include <QMessageBox>
+#include "warmstartcache.h"
+#include "mapview.h"
 #include "pwmgeneration.h"
-#include "foc.h"
 #include "params.h"
-#include "inc_encoder.h"
-#include "teststubs.h"
 #include "my_math.h"
 
-#define GPIOA 0
-#define GPIOB 1
-#define GPIOC 2
-#include "anain.h"
-
 //Current graph
 #define IA 1
 #define IB 2
@@ -77,16 +73,6 @@
 //Op point graph
 #define IDIQAMPS 2
 
-#define TWO_PI_CONT 65536
-
-//c++ test stubs globals
-extern volatile uint16_t g_input_angle;
-extern volatile double g_il1_input;
-extern volatile double g_il2_input;
-
-// C test stubs globals
-extern volatile bool disablePWM;
-
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
@@ -112,10 +98,18 @@ MainWindow::MainWindow(QWidget *parent) :
     if(settings.contains(ui->AddNoise->objectName())) ui->AddNoise->setChecked(settings.value(ui->AddNoise->objectName()).toBool());
     if(settings.contains(ui->NoiseAmp->objectName())) ui->NoiseAmp->setText(settings.value(ui->NoiseAmp->objectName(),QString()).toString());
     if(settings.contains(ui->runTime->objectName())) ui->runTime->setText(settings.value(ui->runTime->objectName(),QString()).toString());
+    if(settings.contains(ui->LiveRatio->objectName())) ui->LiveRatio->setText(settings.value(ui->LiveRatio->objectName(),QString()).toString());
+    if(settings.contains(ui->LiveHistory->objectName())) ui->LiveHistory->setText(settings.value(ui->LiveHistory->objectName(),QString()).toString());
+    if(settings.contains(ui->Trigger->objectName())) ui->Trigger->setText(settings.value(ui->Trigger->objectName(),QString()).toString());
     if(settings.contains(ui->RoadGradient->objectName())) ui->RoadGradient->setText(settings.value(ui->RoadGradient->objectName(),QString()).toString());
     if(settings.contains(ui->ThrotRamps->objectName())) ui->ThrotRamps->setChecked(settings.value(ui->ThrotRamps->objectName()).toBool());
     if(settings.contains(ui->cb_Efficiency->objectName())) ui->cb_Efficiency->setChecked(settings.value(ui->cb_Efficiency->objectName()).toBool());
 
+    recorder = new TraceRecorder();
+    restartSnapshot = nullptr;
+    branchSnapshot = nullptr;
+    branchCount = 0;
+    m_liveSteps = 0;
     motorGraph = new DataGraph("motor", this);
     simulationGraph = new DataGraph("sim", this);
     controllerGraph = new DataGraph("cont", this);
@@ -125,13 +119,7 @@ MainWindow::MainWindow(QWidget *parent) :
     powerGraph = new DataGraph("power", this);
 
     motorGraph->hide();//not sure why needed but otherwise always up?
-
-    ANA_IN_CONFIGURE(ANA_IN_LIST);
-
-    //set any parameters that can upset simulation to safe values
-    Param::SetInt(Param::syncofs,0); //simulator assumes perfect alignment
-    Param::SetInt(Param::pinswap,0); //shouldn't be a problem but may be in the future
-    Param::SetInt(Param::respolepairs,Param::GetInt(Param::polepairs)); //force resolver pole pairs to match motor
+    if(settings.contains(ui->cb_FastPlot->objectName())) ui->cb_FastPlot->setChecked(settings.value(ui->cb_FastPlot->objectName()).toBool()); //once the graphs exist
 
     ui->LqMinusLd->setText(QString::number(Param::GetFloat(Param::lqminusld), 'f', 1));
     ui->FluxLinkage->setText(QString::number(Param::GetInt(Param::fluxlinkage)));
@@ -163,19 +151,19 @@ MainWindow::MainWindow(QWidget *parent) :
 
     m_timestep = 1.0 / ui->LoopFreq->text().toDouble();
     m_Vdc = ui->Vdc->text().toDouble();
-    Param::SetFloat(Param::udc, m_Vdc);
 
     motor = new MotorModel(m_wheelSize,m_gearRatio,m_roadGradient,m_vehicleWeight,m_Lq,m_Ld,m_Rs,m_Poles,m_fluxLinkage,m_timestep,m_syncdelay,m_samplingPoint);
-
-    m_time = 0;
-    m_old_time = 0;
-    m_old_ms_time = 0;
-
-    m_oldVa = 0;
-    m_oldVb = 0;
-    m_oldVc = 0;
-
-    m_lastTorqueDemand = 0;
+    engine = new SimEngine(motor, m_timestep, m_Vdc); //engine takes ownership of the motor model
+    engine->setFlightRecorder(2, "flightrecorder.csv"); //last 2s before a fault
+    m_flightDumps = 0;
+    worker = new SimWorker(engine, this); //runs go to a worker thread, see runFor()
+    on_Trigger_editingFinished(); //once the timestep is known
+    //loaded once the motor exists as the toggle handler applies them
+    if(settings.contains(ui->DynoMode->objectName())) ui->DynoMode->setChecked(settings.value(ui->DynoMode->objectName()).toBool());
+    if(settings.contains(ui->DynoSpeed->objectName())) ui->DynoSpeed->setText(settings.value(ui->DynoSpeed->objectName(),QString()).toString());
+    if(settings.contains(ui->DynoRamp->objectName())) ui->DynoRamp->setText(settings.value(ui->DynoRamp->objectName(),QString()).toString());
+    applyDyno();
+    engine->InitFirmware(); //set any parameters that can upset simulation to safe values
 
     motorGraph->setWindowTitle("Motor Currents");
     motorGraph->setAxisText("", "Amps (A)", "");
@@ -186,6 +174,11 @@ MainWindow::MainWindow(QWidget *parent) :
     motorGraph->setColour(Qt::blue, IQ);
     motorGraph->addSeries("Id (A)", left, ID);
     motorGraph->setColour(Qt::red, ID);
+    motorGraph->bindSeries(IA, recorder, TR_IA);
+    motorGraph->bindSeries(IB, recorder, TR_IB);
+    motorGraph->bindSeries(IC, recorder, TR_IC);
+    motorGraph->bindSeries(IQ, recorder, TR_IQ);
+    motorGraph->bindSeries(ID, recorder, TR_ID);
     if(settings.contains(ui->cb_MotCurr->objectName())) ui->cb_MotCurr->setChecked(settings.value(ui->cb_MotCurr->objectName()).toBool());
     if(settings.contains(ui->cb_PhaseCurrs->objectName())) ui->cb_PhaseCurrs->setChecked(settings.value(ui->cb_PhaseCurrs->objectName()).toBool());
 
@@ -197,6 +190,9 @@ MainWindow::MainWindow(QWidget *parent) :
     simulationGraph->setOpacity(0.25, M_CONT_POS);
     simulationGraph->addSeries("Motor Elec Speed (Hz)", right, M_RPM);
     simulationGraph->setColour(Qt::blue, M_RPM);
+    simulationGraph->bindSeries(M_RPM, recorder, TR_ELEC_FREQ);
+    simulationGraph->bindSeries(M_MOTOR_POS, recorder, TR_MOTOR_POS);
+    simulationGraph->bindSeries(M_CONT_POS, recorder, TR_CONT_POS);
     if(settings.contains(ui->cb_Simulation->objectName())) ui->cb_Simulation->setChecked(settings.value(ui->cb_Simulation->objectName()).toBool());
     if(settings.contains(ui->cb_MotorPos->objectName())) ui->cb_MotorPos->setChecked(settings.value(ui->cb_MotorPos->objectName()).toBool());
 
@@ -209,6 +205,11 @@ MainWindow::MainWindow(QWidget *parent) :
     controllerGraph->setColour(Qt::blue, VQ);
     controllerGraph->addSeries("Vd (V)", left, VD);
     controllerGraph->setColour(Qt::red, VD);
+    controllerGraph->bindSeries(VA, recorder, TR_CVA);
+    controllerGraph->bindSeries(VB, recorder, TR_CVB);
+    controllerGraph->bindSeries(VC, recorder, TR_CVC);
+    controllerGraph->bindSeries(VQ, recorder, TR_CVQ);
+    controllerGraph->bindSeries(VD, recorder, TR_CVD);
     if(settings.contains(ui->cb_ContVolt->objectName())) ui->cb_ContVolt->setChecked(settings.value(ui->cb_ContVolt->objectName()).toBool());
     if(settings.contains(ui->cb_PhaseVolts->objectName())) ui->cb_PhaseVolts->setChecked(settings.value(ui->cb_PhaseVolts->objectName()).toBool());
 
@@ -220,6 +221,9 @@ MainWindow::MainWindow(QWidget *parent) :
     debugGraph->setColour(Qt::red, C_ID);
     debugGraph->addSeries("Ifw (A)", left, C_IFW);
     debugGraph->addSeries("Throttle Reduction (%)", right, C_IVLIM);
+    debugGraph->bindSeries(C_IQ, recorder, TR_CIQ);
+    debugGraph->bindSeries(C_ID, recorder, TR_CID);
+    debugGraph->bindSeries(C_IFW, recorder, TR_CIFW);
     if(settings.contains(ui->cb_ContCurr->objectName())) ui->cb_ContCurr->setChecked(settings.value(ui->cb_ContCurr->objectName()).toBool());
 
     voltageGraph->setWindowTitle("Motor Voltages");
@@ -235,11 +239,21 @@ MainWindow::MainWindow(QWidget *parent) :
     voltageGraph->addSeries("Vd_RdIq (V)", left, VVD_DT_RD);
     voltageGraph->addSeries("VLd (V)", left, VVLD);
     voltageGraph->addSeries("VLq (V)", left, VVLQ);
+    voltageGraph->bindSeries(VVD, recorder, TR_VD);
+    voltageGraph->bindSeries(VVQ, recorder, TR_VQ);
+    voltageGraph->bindSeries(VVQ_BEMF, recorder, TR_VQ_BEMF);
+    voltageGraph->bindSeries(VVQ_DT_ID, recorder, TR_VQ_DT_ID);
+    voltageGraph->bindSeries(VVD_DT_IQ, recorder, TR_VD_DT_IQ);
+    voltageGraph->bindSeries(VVQ_DT_RQ, recorder, TR_VQ_DT_RQ);
+    voltageGraph->bindSeries(VVD_DT_RD, recorder, TR_VD_DT_RD);
+    voltageGraph->bindSeries(VVLD, recorder, TR_VLD);
+    voltageGraph->bindSeries(VVLQ, recorder, TR_VLQ);
     if(settings.contains(ui->cb_MotVolt->objectName())) ui->cb_MotVolt->setChecked(settings.value(ui->cb_MotVolt->objectName()).toBool());
 
     idigGraph->setWindowTitle("Operating Point");
     idigGraph->setAxisText("Id (A)", "Iq (A)", "");
     idigGraph->addSeries("I (A)", left, IDIQAMPS);
+    idigGraph->bindSeries(IDIQAMPS, recorder, TR_IQ, TR_ID);
     if(settings.contains(ui->cb_OpPoint->objectName())) ui->cb_OpPoint->setChecked(settings.value(ui->cb_OpPoint->objectName()).toBool());    
     if(settings.contains(ui->rb_OP_Amps->objectName()))
     {
@@ -253,6 +267,7 @@ MainWindow::MainWindow(QWidget *parent) :
             ui->rb_OP_Volts->setChecked(true);
             idigGraph->setAxisText("Vd (V)", "Vq (V)", "");
             idigGraph->updateSeries("V (V)", left, IDIQAMPS);
+            idigGraph->bindSeries(IDIQAMPS, recorder, TR_VQ, TR_VD);
         }
     }
 
@@ -262,6 +277,7 @@ MainWindow::MainWindow(QWidget *parent) :
     powerGraph->addSeries("Torque (Nm)", right, TORQUE);
     powerGraph->addSeries("Elec Power (kW)", left, ELEC_POWER);
     powerGraph->addSeries("Efficiency (%)", left, EFFICIENCY);
+    bindPowerGraph(TR_SHAFT_RPM);
     if(settings.contains(ui->cb_PowTorqTime->objectName())) ui->cb_PowTorqTime->setChecked(settings.value(ui->cb_PowTorqTime->objectName()).toBool());
     if(settings.contains(ui->rb_Speed->objectName()))
     {
@@ -274,42 +290,73 @@ MainWindow::MainWindow(QWidget *parent) :
         {
             ui->rb_Time->setChecked(true);
             powerGraph->setAxisText("Time (s)", "Power (kW)", "Torque (Nm)");
+            bindPowerGraph(TR_TIME);
         }
     }
 
-    //following block copied from OpenInverter - probably not needed
-    Param::SetInt(Param::version, 4); //backward compatibility
-
-    if (Param::GetInt(Param::snsm) < 12)
-        Param::SetInt(Param::snsm, Param::GetInt(Param::snsm) + 10); //upgrade parameter
-    if (Param::Get(Param::offthrotregen) > 0)
-        Param::Set(Param::offthrotregen, -Param::Get(Param::offthrotregen));
-
-
-    Param::Change(Param::PARAM_LAST);
-    Param::Change(Param::nodeid);
-
-    PwmGeneration::SetOpmode(0);
-    PwmGeneration::SetOpmode(ui->opMode->text().toInt());
-    Param::SetInt(Param::dir, ui->direction->text().toInt());
+    applyRunOptions();
+    engine->StartFirmware(ui->opMode->text().toInt(), ui->direction->text().toInt());
 
     ui->Poles->setText(QString::number(Param::GetInt(Param::polepairs)));
     ui->throttleCurrent->setText(QString::number(Param::GetFloat(Param::throtcur), 'f', 1));
 
-    FOC::SetMotorParameters(Param::GetFloat(Param::lqminusld)/1000, Param::GetFloat(Param::fluxlinkage)/1000);
-
-    PwmGeneration::SetTorquePercent(ui->torqueDemand->text().toFloat());
-
-    //run for 1sec to complete motor init
-    runFor(8789);
+    //run for 1sec to complete motor init, unless a saved state for these settings is on disk
+    if(!ui->AddNoise->isChecked())
+        restartSnapshot = WarmStartCache().Load(warmStartKey(), engine);
+    if(restartSnapshot && !engine->Restore(restartSnapshot))
+    {
+        delete restartSnapshot;
+        restartSnapshot = nullptr;
+    }
+    if(!restartSnapshot)
+        engine->RunFor(8789);
     on_pbRestart_clicked();
+
+    //anything that changes the warm up or the model makes saved states stale, run time and torque demand don't
+    foreach(QLineEdit *edit, findChildren<QLineEdit *>())
+    {
+        if(isModelField(edit))
+            connect(edit, &QLineEdit::textEdited, this, &MainWindow::invalidateSnapshots);
+    }
+    connect(ui->ExtraCycleDelay, &QCheckBox::clicked, this, &MainWindow::invalidateSnapshots);
+    connect(ui->AddNoise, &QCheckBox::clicked, this, &MainWindow::invalidateSnapshots);
+    connect(ui->ThrotRamps, &QCheckBox::clicked, this, &MainWindow::invalidateSnapshots);
+    connect(ui->DynoMode, &QCheckBox::clicked, this, &MainWindow::invalidateSnapshots);
+    ui->pbSnapshot->setEnabled(FirmwareContext::isSupported());
+
+    //the traces come back from the worker a chunk at a time and are drawn at the frame rate
+    frameTimer = new QTimer(this);
+    frameTimer->setInterval(40);
+    connect(frameTimer, &QTimer::timeout, this, &MainWindow::frameTick);
+    runProgress = new QProgressBar(this);
+    runProgress->setMaximumWidth(200);
+    runProgress->hide();
+    pbCancel = new QPushButton("Cancel", this);
+    pbCancel->hide();
+    connect(pbCancel, &QPushButton::clicked, this, &MainWindow::cancelRun);
+    ui->statusBar->addPermanentWidget(runProgress);
+    ui->statusBar->addPermanentWidget(pbCancel);
 }
 
 MainWindow::~MainWindow()
 {
+    delete worker; //stops the run before the engine goes
+    delete restartSnapshot;
+    delete branchSnapshot;
+    delete engine;
+    delete recorder;
     delete ui;
 }
 
+//power graph is plotted against either shaft speed or time
+void MainWindow::bindPowerGraph(int xChannel)
+{
+    powerGraph->bindSeries(POWER, recorder, TR_POWER, xChannel);
+    powerGraph->bindSeries(TORQUE, recorder, TR_TORQUE, xChannel);
+    powerGraph->bindSeries(ELEC_POWER, recorder, TR_ELEC_POWER, xChannel);
+    powerGraph->bindSeries(EFFICIENCY, recorder, TR_EFFICIENCY, xChannel);
+}
+
 void MainWindow::closeEvent(QCloseEvent *event)
 {
     QSettings settings("OpenInverter", "IPMMotorSim");
@@ -330,8 +377,14 @@ void MainWindow::closeEvent(QCloseEvent *event)
     settings.setValue(ui->AddNoise->objectName(), ui->AddNoise->isChecked());
     settings.setValue(ui->NoiseAmp->objectName(), ui->NoiseAmp->text());
     settings.setValue(ui->runTime->objectName(), ui->runTime->text());
+    settings.setValue(ui->LiveRatio->objectName(), ui->LiveRatio->text());
+    settings.setValue(ui->LiveHistory->objectName(), ui->LiveHistory->text());
+    settings.setValue(ui->Trigger->objectName(), ui->Trigger->text());
     settings.setValue(ui->ThrotRamps->objectName(), ui->ThrotRamps->isChecked());
     settings.setValue(ui->RoadGradient->objectName(), ui->RoadGradient->text());
+    settings.setValue(ui->DynoMode->objectName(), ui->DynoMode->isChecked());
+    settings.setValue(ui->DynoSpeed->objectName(), ui->DynoSpeed->text());
+    settings.setValue(ui->DynoRamp->objectName(), ui->DynoRamp->text());
 
     settings.setValue(ui->cb_ContCurr->objectName(), ui->cb_ContCurr->isChecked());
     settings.setValue(ui->cb_ContVolt->objectName(), ui->cb_ContVolt->isChecked());
@@ -342,6 +395,7 @@ void MainWindow::closeEvent(QCloseEvent *event)
     settings.setValue(ui->cb_Simulation->objectName(), ui->cb_Simulation->isChecked());
     settings.setValue(ui->rb_Speed->objectName(), ui->rb_Speed->isChecked());
     settings.setValue(ui->cb_Efficiency->objectName(), ui->cb_Efficiency->isChecked());
+    settings.setValue(ui->cb_FastPlot->objectName(), ui->cb_FastPlot->isChecked());
 
     settings.setValue(ui->cb_PhaseCurrs->objectName(), ui->cb_PhaseCurrs->isChecked());
     settings.setValue(ui->cb_MotorPos->objectName(), ui->cb_MotorPos->isChecked());
@@ -358,230 +412,209 @@ void MainWindow::closeEvent(QCloseEvent *event)
     QWidget::closeEvent(event);
 }
 
-void MainWindow::runFor(int num_steps)
+//the run options that don't have an editingFinished handler
+//widgets are read once here, the run itself never touches them
+RunConfig MainWindow::runOptions(void)
 {
-    double Va = 0;
-    double Vb = 0;
-    double Vc = 0;
-
-    if(num_steps<0)
-        return;
+    RunConfig config;
+    config.torqueDemand = ui->torqueDemand->text().toDouble();
+    config.throttleRamps = ui->ThrotRamps->isChecked();
+    config.extraCycleDelay = ui->ExtraCycleDelay->isChecked();
+    config.addNoise = ui->AddNoise->isChecked();
+    config.noiseAmp = ui->NoiseAmp->text().toDouble();
+    return config;
+}
 
-    QList<QPointF> listIa, listIb, listIc, listIq, listId;
-    QList<QPointF> listMFreq, listMPos, listContMPos;
-    QList<QPointF> listCVa, listCVb, listCVc, listCVq, listCVd, listCIq, listCId, listCifw;//, listCivlim;
-    QList<QPointF> listVVd, listVVq, listVVq_bemf, listVVq_dueto_id, listVVd_dueto_iq, listVVq_dueto_Rq, listVVd_dueto_Rd, listVVLd, listVVLq;
-    QList<QPointF> listIdIq;
-    QList<QPointF> listPower, listTorque, listElecPower, listEfficiency;
+void MainWindow::applyRunOptions(void)
+{
+    engine->setRunConfig(runOptions());
+}
 
-    //PwmGeneration::SetTorquePercent(ui->torqueDemand->text().toFloat());
-    for(int i = 0;i<num_steps; i++)
-    {
-        //routines that need calling every 10ms
-        if((uint32_t)(m_time*100) != m_old_time)
-        {
-            m_old_time = (uint32_t)(m_time*100);
-            Encoder::UpdateRotorFrequency(100);
-
-            int requestedTorque = ui->torqueDemand->text().toInt() * 100;
-            if(ui->ThrotRamps->isChecked())
-            {
-                //ramps set at 5% above 0 and 0.5% below
-                if(m_lastTorqueDemand != requestedTorque)
-                {
-                    if(requestedTorque > m_lastTorqueDemand)
-                        requestedTorque = RAMPUP(m_lastTorqueDemand, requestedTorque, ((m_lastTorqueDemand>=0)?500:50));
-                    else
-                        requestedTorque = RAMPDOWN(m_lastTorqueDemand, requestedTorque, ((m_lastTorqueDemand>=0)?500:50));
-                    m_lastTorqueDemand = requestedTorque;
-                }
-                PwmGeneration::SetTorquePercent(((float)(requestedTorque+50))/100);
-            }
-            else
-                PwmGeneration::SetTorquePercent(ui->torqueDemand->text().toFloat());
-        }
+//jump to the dyno speed or ramp there from the current speed, the speed is kept when the dyno is turned off
+void MainWindow::applyDyno(void)
+{
+    double rpm = ui->DynoSpeed->text().toDouble();
+    double ramp = ui->DynoRamp->text().toDouble();
+    bool dyno = ui->DynoMode->isChecked();
+    apply([=]{
+        motor->setDyno(dyno);
+        if(ramp > 0)
+            motor->setDynoRamp(rpm, ramp);
+        else
+            motor->setDynoSpeed(rpm);
+    });
+}
 
-        //routines that need calling every ms
-        if((uint32_t)(m_time*1000) != m_old_ms_time)
-        {
-            m_old_ms_time = (uint32_t)(m_time*100);
-            //not used at the moment but left in for future use
-        }        
+void MainWindow::runFor(int num_steps)
+{
+    if(num_steps<0)
+        return;
 
-        g_input_angle = (uint16_t)((motor->getElecPosition()*TWO_PI_CONT)/360.0);
-        if(disablePWM)
-        {
-            g_il1_input = 0;
-            g_il2_input = 0;
-        }
-        else
-        {
-            g_il1_input = (Param::GetFloat(Param::il1gain)*motor->getIaSamp());
-            g_il2_input = (Param::GetFloat(Param::il2gain)*motor->getIbSamp());
-        }
+    //queued with the options as they are now, so sequences like Transient can change them between runs
+    updateSubscriptions();
+    worker->Queue(num_steps, runOptions(), recorder->enabledChannels(), activeTrigger());
+    startRun();
+}
 
-        if(ui->AddNoise->isChecked())
-        {
-            double noise = ui->NoiseAmp->text().toDouble();
-            g_il1_input += QRandomGenerator::global()->bounded(noise) - (noise/2);
-            g_il2_input += QRandomGenerator::global()->bounded(noise) - (noise/2);
-        }
+void MainWindow::startRun(void)
+{
+    if(frameTimer->isActive())
+        return;
+    setControlsEnabled(false);
+    runProgress->setValue(0);
+    runProgress->setVisible(!ui->cb_Live->isChecked());
+    pbCancel->show();
+    frameTimer->start();
+}
 
-        PwmGeneration::Run();
+void MainWindow::finishRun(void)
+{
+    frameTimer->stop();
+    runProgress->hide();
+    pbCancel->hide();
+    setControlsEnabled(true);
+    if(m_trigger.isEnabled())
+        ui->statusBar->showMessage(QString("%1 trigger events since restart").arg(m_trigger.getEvents().size()));
+}
 
-        if(disablePWM) //needed to allow OpeinInverter initialisation to complete
-        {
-            Va = 0;
-            Vb = 0;
-            Vc = 0;
-        }
-        else
-        {
-            Va = (m_Vdc/65536) * (FOC::DutyCycles[0]-32768);
-            Vb = (m_Vdc/65536) * (FOC::DutyCycles[1]-32768);
-            Vc = (m_Vdc/65536) * (FOC::DutyCycles[2]-32768);
-        }
+//the engine and the firmware Params belong to the worker while it runs
+//only live runs take edits, they are passed to the worker by apply()
+void MainWindow::setControlsEnabled(bool enabled)
+{
+    bool live = ui->cb_Live->isChecked();
+    ui->groupBox->setEnabled(enabled || live);
+    ui->groupBox_4->setEnabled(enabled || live);
+    foreach(QPushButton *button, ui->groupBox_2->findChildren<QPushButton *>())
+        button->setEnabled(enabled);
+    ui->runTime->setEnabled(enabled);
+    ui->Trigger->setEnabled(enabled);
+    ui->cb_Live->setEnabled(enabled || live);
+    if(enabled)
+    {
+        ui->pbSnapshot->setEnabled(FirmwareContext::isSupported());
+        ui->pbBranch->setEnabled(branchSnapshot != nullptr);
+    }
+}
 
-        //add voltages to plot here so that we see the SVM waveforms
-        if(ui->cb_PhaseVolts->isChecked())
-        {
-            listCVa.append(QPointF(m_time, Va));
-            listCVb.append(QPointF(m_time, Vb));
-            listCVc.append(QPointF(m_time, Vc));
-        }
+//changes to the engine, motor model or Params are made by the worker while it has them
+void MainWindow::apply(std::function<void(void)> change)
+{
+    if(worker->isBusy())
+        worker->Post(change);
+    else
+        change();
+}
 
-        //remove space vector modulation
-        double offset = Va + Vb + Vc;
-        Va = Va - offset/3;
-        Vb = Vb - offset/3;
-        Vc = Vc - offset/3;
+void MainWindow::frameTick()
+{
+    if(ui->cb_Live->isChecked())
+        queueLive();
+    bool busy = worker->isBusy(); //read first, once it is idle every chunk is already in the ring
+    if(worker->Collect(recorder))
+        updateGraphs();
+    qint64 queued = worker->getStepsQueued();
+    if(queued > 0)
+        runProgress->setValue(int((100 * worker->getStepsDone()) / queued));
+    FlightRecorder &flight = engine->getFlightRecorder();
+    if(flight.getDumps() != m_flightDumps)
+    {
+        m_flightDumps = flight.getDumps();
+        ui->statusBar->showMessage("Flight recorder: " + flight.getFaultReason() + ", written to " + flight.getDumpFile());
+    }
+    if(!busy && !ui->cb_Live->isChecked())
+        finishRun();
+}
 
-        //one period delay to simulate slow timer reload in target hardware
-        if(ui->ExtraCycleDelay->isChecked())
-            motor->Step(m_oldVa,m_oldVb,m_oldVc);
-        else
-            motor->Step(Va,Vb,Vc);
-        m_oldVa = Va;
-        m_oldVb = Vb;
-        m_oldVb = Vb;
+//stops at the end of the current chunk, what has been run so far is kept
+void MainWindow::cancelRun()
+{
+    ui->cb_Live->setChecked(false);
+    worker->Cancel();
+}
 
-        //motor->Step(0,0,0);
-        if(ui->cb_PhaseCurrs->isChecked())
-        {
-            listIa.append(QPointF(m_time, motor->getIaSamp()));
-            listIb.append(QPointF(m_time, motor->getIbSamp()));
-            listIc.append(QPointF(m_time, motor->getIcSamp()));
-        }
-        listIq.append(QPointF(m_time, motor->getIq()));
-        listId.append(QPointF(m_time, motor->getId()));
+//queue the steps that bring the simulation up to the live ratio of the time since the last frame
+//no more than a chunk is owed, so a simulation that can't keep up falls behind rather than building a backlog
+void MainWindow::queueLive(void)
+{
+    double ratio = qMax(0.0, ui->LiveRatio->text().toDouble());
+    m_liveSteps = qMin(m_liveSteps + (m_liveClock.restart() * 0.001 * ratio / m_timestep), double(WORKER_CHUNK_STEPS));
+    int steps = int(m_liveSteps);
+    if(steps > 0 && worker->getStepsQueued() - worker->getStepsDone() < WORKER_CHUNK_STEPS)
+    {
+        updateSubscriptions();
+        worker->Queue(steps, runOptions(), recorder->enabledChannels(), activeTrigger());
+        m_liveSteps -= steps;
+    }
+}
 
-        listMFreq.append(QPointF(m_time, (motor->getMotorFreq()*m_Poles)));
-        if(ui->cb_MotorPos->isChecked())
-        {
-            listMPos.append(QPointF(m_time, motor->getMotorPosition()));
-            listContMPos.append(QPointF(m_time, (360.0 * PwmGeneration::GetAngle())/TWO_PI_CONT));
-        }
+//live runs keep a fixed length of history, old rows are dropped from the recorder and the time graphs scroll
+void MainWindow::applyLiveHistory(void)
+{
+    double history = ui->cb_Live->isChecked() ? qMax(m_timestep, ui->LiveHistory->text().toDouble()) : 0;
+    recorder->setHistoryLimit(int(history / m_timestep));
+    motorGraph->setScrollWidth(history);
+    simulationGraph->setScrollWidth(history);
+    controllerGraph->setScrollWidth(history);
+    debugGraph->setScrollWidth(history);
+    voltageGraph->setScrollWidth(history);
+    powerGraph->setScrollWidth(ui->rb_Speed->isChecked() ? 0 : history);
+}
 
-          //inlcude here to see sinusoidal waveforms that motor sees
-//        if(ui->cb_PhaseVolts->isChecked())
-//        {
-//            listCVa.append(QPointF(m_time, Va));
-//            listCVb.append(QPointF(m_time, Vb));
-//            listCVc.append(QPointF(m_time, Vc));
-//        }
-        listCVq.append(QPointF(m_time, (m_Vdc/65536) * Param::GetFloat(Param::uq)));
-        listCVd.append(QPointF(m_time, (m_Vdc/65536) * Param::GetFloat(Param::ud)));
-
-        listCIq.append(QPointF(m_time, Param::GetFloat(Param::iq)));
-        listCId.append(QPointF(m_time, Param::GetFloat(Param::id)));
-
-        listCifw.append(QPointF(m_time, Param::GetFloat(Param::ifw)));
-        //listCivlim.append(QPointF(m_time, Param::GetFloat(Param::vlim)));
-
-        listVVd.append(QPointF(m_time, motor->getVd()));
-        listVVq.append(QPointF(m_time, motor->getVq()));
-        listVVq_bemf.append(QPointF(m_time, motor->getVq_bemf()));
-        listVVq_dueto_id.append(QPointF(m_time, motor->getVq_dueto_id()));
-        listVVd_dueto_iq.append(QPointF(m_time, motor->getVd_dueto_iq()));
-        listVVq_dueto_Rq.append(QPointF(m_time, motor->getVq_dueto_Rq()));
-        listVVd_dueto_Rd.append(QPointF(m_time, motor->getVd_dueto_Rd()));
-        listVVLd.append(QPointF(m_time, motor->getVLd()));
-        listVVLq.append(QPointF(m_time, motor->getVLq()));
-
-        if(ui->rb_OP_Amps->isChecked())
-            listIdIq.append(QPointF(motor->getId(), motor->getIq()));
-        else
-            listIdIq.append(QPointF(motor->getVd(), motor->getVq()));
+void MainWindow::on_cb_Live_toggled(bool checked)
+{
+    applyLiveHistory();
+    if(checked)
+    {
+        m_liveSteps = 0;
+        m_liveClock.start();
+        startRun();
+    }
+    else if(frameTimer->isActive())
+        setControlsEnabled(false); //runs already queued finish as a normal run
+}
 
-        double elec_power=0, efficiency=0;
-        if(ui->cb_Efficiency->isChecked())
-        {
-            elec_power = (Va * motor->getIaSamp()) + (Vb * motor->getIbSamp()) + (Vc * motor->getIcSamp());
-            efficiency = 100.0 * (motor->getPower()/elec_power);
-        }
+void MainWindow::on_LiveHistory_editingFinished()
+{
+    applyLiveHistory();
+}
 
-        if(ui->rb_Speed->isChecked())
-        {
-            listPower.append(QPointF(motor->getMotorFreq()*60, motor->getPower()/1000));
-            listTorque.append(QPointF(motor->getMotorFreq()*60, motor->getTorque()));
-            if(ui->cb_Efficiency->isChecked())
-            {
-                listElecPower.append(QPointF(motor->getMotorFreq()*60, elec_power/1000));
-                listEfficiency.append(QPointF(motor->getMotorFreq()*60, efficiency));
-            }
-        }
-        else
-        {
-            listPower.append(QPointF(m_time, motor->getPower()/1000));
-            listTorque.append(QPointF(m_time, motor->getTorque()));
-            if(ui->cb_Efficiency->isChecked())
-            {
-                listElecPower.append(QPointF(m_time, elec_power/1000));
-                listEfficiency.append(QPointF(m_time, efficiency));
-            }
-        }
+TriggerCapture *MainWindow::activeTrigger(void)
+{
+    return m_trigger.isEnabled() ? &m_trigger : nullptr;
+}
 
-        m_time += m_timestep;
+//runs only record the windows around trigger events while there are conditions, see TriggerCapture::Parse()
+void MainWindow::on_Trigger_editingFinished()
+{
+    if(!m_trigger.Parse(ui->Trigger->text()))
+    {
+        QMessageBox::warning(this, "Trigger", m_trigger.getError());
+        m_trigger.Parse(QString());
     }
+    m_trigger.Reset(m_timestep);
+}
 
-    motorGraph->addDataPoints(listIa, IA);
-    motorGraph->addDataPoints(listIb, IB);
-    motorGraph->addDataPoints(listIc, IC);
-    motorGraph->addDataPoints(listIq, IQ);
-    motorGraph->addDataPoints(listId, ID);
-
-    simulationGraph->addDataPoints(listMFreq, M_RPM);
-    simulationGraph->addDataPoints(listMPos, M_MOTOR_POS);
-    simulationGraph->addDataPoints(listContMPos, M_CONT_POS);
-
-    controllerGraph->addDataPoints(listCVa, VA);
-    controllerGraph->addDataPoints(listCVb, VB);
-    controllerGraph->addDataPoints(listCVc, VC);
-    controllerGraph->addDataPoints(listCVq, VQ);
-    controllerGraph->addDataPoints(listCVd, VD);
-
-    debugGraph->addDataPoints(listCIq, C_IQ);
-    debugGraph->addDataPoints(listCId, C_ID);
-    debugGraph->addDataPoints(listCifw, C_IFW);
-    //debugGraph->addDataPoints(listCivlim, C_IVLIM);
-
-    voltageGraph->addDataPoints(listVVd, VVD);
-    voltageGraph->addDataPoints(listVVq, VVQ);
-    voltageGraph->addDataPoints(listVVq_bemf, VVQ_BEMF);
-    voltageGraph->addDataPoints(listVVq_dueto_id, VVQ_DT_ID);
-    voltageGraph->addDataPoints(listVVd_dueto_iq, VVD_DT_IQ);
-    voltageGraph->addDataPoints(listVVq_dueto_Rq, VVQ_DT_RQ);
-    voltageGraph->addDataPoints(listVVd_dueto_Rd, VVD_DT_RD);
-    voltageGraph->addDataPoints(listVVLd, VVLD);
-    voltageGraph->addDataPoints(listVVLq, VVLQ);
-
-    idigGraph->addDataPoints(listIdIq, IDIQAMPS);
-
-    powerGraph->addDataPoints(listPower, POWER);
-    powerGraph->addDataPoints(listTorque, TORQUE);
-    powerGraph->addDataPoints(listElecPower, ELEC_POWER);
-    powerGraph->addDataPoints(listEfficiency, EFFICIENCY);
+//each open window records the channels of its series, less any its detail checkboxes turn off
+//channels nobody wants are not recorded at all, opening a window later only shows data from then on
+void MainWindow::updateSubscriptions(void)
+{
+    ChannelMask off = 0;
+    if(!ui->cb_PhaseVolts->isChecked()) off |= TR_CHANNEL(TR_CVA) | TR_CHANNEL(TR_CVB) | TR_CHANNEL(TR_CVC);
+    if(!ui->cb_PhaseCurrs->isChecked()) off |= TR_CHANNEL(TR_IA) | TR_CHANNEL(TR_IB) | TR_CHANNEL(TR_IC);
+    if(!ui->cb_MotorPos->isChecked()) off |= TR_CHANNEL(TR_MOTOR_POS) | TR_CHANNEL(TR_CONT_POS);
+    if(!ui->cb_Efficiency->isChecked()) off |= TR_CHANNEL(TR_ELEC_POWER) | TR_CHANNEL(TR_EFFICIENCY);
+
+    recorder->subscribe(motorGraph, ui->cb_MotCurr->isChecked() ? (motorGraph->channels() & ~off) : 0);
+    recorder->subscribe(simulationGraph, ui->cb_Simulation->isChecked() ? (simulationGraph->channels() & ~off) : 0);
+    recorder->subscribe(controllerGraph, ui->cb_ContVolt->isChecked() ? (controllerGraph->channels() & ~off) : 0);
+    recorder->subscribe(debugGraph, ui->cb_ContCurr->isChecked() ? (debugGraph->channels() & ~off) : 0);
+    recorder->subscribe(voltageGraph, ui->cb_MotVolt->isChecked() ? (voltageGraph->channels() & ~off) : 0);
+    recorder->subscribe(idigGraph, ui->cb_OpPoint->isChecked() ? (idigGraph->channels() & ~off) : 0);
+    recorder->subscribe(powerGraph, ui->cb_PowTorqTime->isChecked() ? (powerGraph->channels() & ~off) : 0);
+}
 
+void MainWindow::updateGraphs(void)
+{
     if(ui->cb_MotCurr->isChecked()) motorGraph->updateGraph();
     if(ui->cb_Simulation->isChecked()) simulationGraph->updateGraph();
     if(ui->cb_ContVolt->isChecked()) controllerGraph->updateGraph();
@@ -594,64 +627,85 @@ void MainWindow::runFor(int num_steps)
 void MainWindow::on_vehicleWeight_editingFinished()
 {
     m_vehicleWeight = ui->vehicleWeight->text().toDouble();
-    motor->setVehicleMass(m_vehicleWeight);
+    double val = m_vehicleWeight;
+    apply([=]{motor->setVehicleMass(val);});
 }
 
 void MainWindow::on_wheelSize_editingFinished()
 {
     m_wheelSize = ui->wheelSize->text().toDouble();
-    motor->setWheelSize(m_wheelSize);
+    double val = m_wheelSize;
+    apply([=]{motor->setWheelSize(val);});
 }
 
 void MainWindow::on_gearRatio_editingFinished()
 {
     m_gearRatio = ui->gearRatio->text().toDouble();
-    motor->setGboxRatio(m_gearRatio);
+    double val = m_gearRatio;
+    apply([=]{motor->setGboxRatio(val);});
 }
 
 void MainWindow::on_Vdc_editingFinished()
 {
     m_Vdc = ui->Vdc->text().toDouble();
-    Param::SetFloat(Param::udc, m_Vdc);
+    double val = m_Vdc;
+    apply([=]{engine->setVdc(val);});
 }
 
 void MainWindow::on_Lq_editingFinished()
 {
     m_Lq = ui->Lq->text().toDouble()/1000;
-    motor->setLq(m_Lq);
+    double val = m_Lq;
+    apply([=]{motor->setLq(val);});
 }
 
 void MainWindow::on_Ld_editingFinished()
 {
     m_Ld = ui->Ld->text().toDouble()/1000;
-    motor->setLd(m_Ld);
+    double val = m_Ld;
+    apply([=]{motor->setLd(val);});
 }
 
 void MainWindow::on_Rs_editingFinished()
 {
     m_Rs = ui->Rs->text().toDouble();
-    motor->setRs(m_Rs);
+    double val = m_Rs;
+    apply([=]{motor->setRs(val);});
 }
 
 void MainWindow::on_Poles_editingFinished()
 {
     m_Poles = ui->Poles->text().toDouble();
-    Param::Set(Param::polepairs, FP_FROMINT(ui->Poles->text().toInt()));
-    Param::Set(Param::respolepairs,FP_FROMINT(ui->Poles->text().toInt())); //force resolver pole pairs to match motor
-    motor->setPoles(m_Poles);
+    double poles = m_Poles;
+    int polepairs = ui->Poles->text().toInt();
+    apply([=]{
+        Param::Set(Param::polepairs, FP_FROMINT(polepairs));
+        Param::Set(Param::respolepairs,FP_FROMINT(polepairs)); //force resolver pole pairs to match motor
+        motor->setPoles(poles);
+    });
 }
 
 void MainWindow::on_FluxLinkage_editingFinished()
 {
     m_fluxLinkage = ui->FluxLinkage->text().toDouble()/1000;
-    Param::Set(Param::fluxlinkage, FP_FROMFLT(ui->FluxLinkage->text().toFloat()));
-    motor->setFluxLinkage(m_fluxLinkage);
-    PwmGeneration::SetTorquePercent(ui->torqueDemand->text().toFloat()); //make sure is recalculated
+    double val = m_fluxLinkage;
+    float fluxlinkage = ui->FluxLinkage->text().toFloat();
+    float torque = ui->torqueDemand->text().toFloat();
+    apply([=]{
+        Param::Set(Param::fluxlinkage, FP_FROMFLT(fluxlinkage));
+        motor->setFluxLinkage(val);
+        PwmGeneration::SetTorquePercent(torque); //make sure is recalculated
+    });
 }
 
 void MainWindow::on_LoopFreq_editingFinished()
 {
     m_timestep = 1.0 / ui->LoopFreq->text().toDouble();
+    double val = m_timestep;
+    apply([=]{
+        engine->setTimestep(val);
+        m_trigger.Reset(val); //window lengths are held in steps
+    });
 }
 
 void MainWindow::on_pbRunFor_clicked()
@@ -686,18 +740,29 @@ void MainWindow::on_pbStep_clicked()
 
 void MainWindow::on_pbRestart_clicked()
 {
-    motor->Restart();
-    int throt = ui->torqueDemand->text().toInt();
-    ui->torqueDemand->setText(QString::number(0));
-    PwmGeneration::SetOpmode(0);
-    PwmGeneration::SetOpmode(ui->opMode->text().toInt()); //reset controller integrators
-    PwmGeneration::SetTorquePercent(0);
-    runFor(6000); //allow controller to complete initialisation
-    ui->torqueDemand->setText(QString::number(throt));
-    PwmGeneration::SetTorquePercent(ui->torqueDemand->text().toFloat());
-    testStubsClearEncoder();
-    m_time = 0;
-    motor->Restart();
+    applyRunOptions();
+    if(!restartSnapshot || !engine->Restore(restartSnapshot)) //nothing has changed since the last warm up
+    {
+        delete restartSnapshot;
+        WarmStartCache cache;
+        bool useCache = !ui->AddNoise->isChecked(); //noise makes the warm up random
+        restartSnapshot = useCache ? cache.Load(warmStartKey(), engine) : nullptr;
+        if(restartSnapshot && !engine->Restore(restartSnapshot))
+        {
+            delete restartSnapshot;
+            restartSnapshot = nullptr;
+        }
+        if(!restartSnapshot)
+        {
+            engine->Restart(ui->opMode->text().toInt());
+            if(FirmwareContext::isSupported())
+                restartSnapshot = engine->Snapshot();
+            if(restartSnapshot && useCache)
+                cache.Save(warmStartKey(), restartSnapshot);
+        }
+    }
+    recorder->clear();
+    m_trigger.Reset(m_timestep);
     motorGraph->clearData();
     simulationGraph->clearData();
     controllerGraph->clearData();
@@ -710,71 +775,93 @@ void MainWindow::on_pbRestart_clicked()
 
 void MainWindow::on_torqueDemand_editingFinished()
 {
-    PwmGeneration::SetTorquePercent(ui->torqueDemand->text().toFloat());
+    double val = ui->torqueDemand->text().toDouble();
+    apply([=]{
+        engine->setTorqueDemand(val);
+        PwmGeneration::SetTorquePercent(val);
+    });
 }
 
 void MainWindow::on_throttleCurrent_editingFinished()
 {
-    Param::Set(Param::throtcur, FP_FROMFLT(ui->throttleCurrent->text().toFloat()));
-    PwmGeneration::SetTorquePercent(ui->torqueDemand->text().toFloat()); //make sure is recalculated
+    float throtcur = ui->throttleCurrent->text().toFloat();
+    float torque = ui->torqueDemand->text().toFloat();
+    apply([=]{
+        Param::Set(Param::throtcur, FP_FROMFLT(throtcur));
+        PwmGeneration::SetTorquePercent(torque); //make sure is recalculated
+    });
 }
 
 void MainWindow::on_opMode_editingFinished()
 {
-    PwmGeneration::SetOpmode(ui->opMode->text().toInt());
+    int opmode = ui->opMode->text().toInt();
+    apply([=]{PwmGeneration::SetOpmode(opmode);});
 }
 
 void MainWindow::on_direction_editingFinished()
 {
-    Param::Set(Param::dir, FP_FROMINT(ui->direction->text().toInt()));
+    int val = ui->direction->text().toInt();
+    apply([=]{Param::Set(Param::dir, FP_FROMINT(val));});
 }
 
 void MainWindow::on_IqManual_editingFinished()
 {
-    Param::Set(Param::manualiq, FP_FROMFLT(ui->IqManual->text().toFloat()));
+    float val = ui->IqManual->text().toFloat();
+    apply([=]{Param::Set(Param::manualiq, FP_FROMFLT(val));});
 }
 
 void MainWindow::on_IdManual_editingFinished()
 {
-    Param::Set(Param::manualid, FP_FROMFLT(ui->IdManual->text().toFloat()));
+    float val = ui->IdManual->text().toFloat();
+    apply([=]{Param::Set(Param::manualid, FP_FROMFLT(val));});
 }
 
 void MainWindow::on_CurrentKp_editingFinished()
 {
-    Param::Set(Param::curkp, FP_FROMINT(ui->CurrentKp->text().toInt()));
+    int val = ui->CurrentKp->text().toInt();
+    apply([=]{Param::Set(Param::curkp, FP_FROMINT(val));});
 }
 
 void MainWindow::on_CurrentKi_editingFinished()
 {
-    Param::Set(Param::curki, FP_FROMINT(ui->CurrentKi->text().toInt()));
+    int val = ui->CurrentKi->text().toInt();
+    apply([=]{Param::Set(Param::curki, FP_FROMINT(val));});
 }
 
 void MainWindow::on_SyncAdv_editingFinished()
 {
-    Param::Set(Param::syncadv, FP_FROMINT(ui->SyncAdv->text().toInt()));
+    int val = ui->SyncAdv->text().toInt();
+    apply([=]{Param::Set(Param::syncadv, FP_FROMINT(val));});
 }
 
 void MainWindow::on_LqMinusLd_editingFinished()
 {
-    Param::Set(Param::lqminusld, FP_FROMFLT(ui->LqMinusLd->text().toFloat()));
-    PwmGeneration::SetTorquePercent(ui->torqueDemand->text().toFloat()); //make sure MTPA is recalculated
+    float lqminusld = ui->LqMinusLd->text().toFloat();
+    float torque = ui->torqueDemand->text().toFloat();
+    apply([=]{
+        Param::Set(Param::lqminusld, FP_FROMFLT(lqminusld));
+        PwmGeneration::SetTorquePercent(torque); //make sure MTPA is recalculated
+    });
 }
 
 void MainWindow::on_SyncDelay_editingFinished()
 {
     m_syncdelay = ui->SyncDelay->text().toDouble()/1000000; //entered in uS
-    motor->setSyncDelay(m_syncdelay);
+    double val = m_syncdelay;
+    apply([=]{motor->setSyncDelay(val);});
 }
 
 void MainWindow::on_FreqMax_editingFinished()
 {
-    Param::Set(Param::fmax, FP_FROMFLT(ui->FreqMax->text().toFloat()));
+    float val = ui->FreqMax->text().toFloat();
+    apply([=]{Param::Set(Param::fmax, FP_FROMFLT(val));});
 }
 
 void MainWindow::on_SamplingPoint_editingFinished()
 {
     m_samplingPoint = ui->SamplingPoint->text().toDouble()/100.0; //entered in %
-    motor->setSamplingPoint(m_samplingPoint);
+    double val = m_samplingPoint;
+    apply([=]{motor->setSamplingPoint(val);});
 }
 
 void MainWindow::on_pbTransient_clicked()
@@ -791,7 +878,8 @@ void MainWindow::on_pbTransient_clicked()
 
 void MainWindow::on_SyncOfs_editingFinished()
 {
-    Param::Set(Param::syncofs, FP_FROMINT(ui->SyncOfs->text().toInt()));
+    int val = ui->SyncOfs->text().toInt();
+    apply([=]{Param::Set(Param::syncofs, FP_FROMINT(val));});
 }
 
 void MainWindow::on_pbAccelCoast_clicked()
@@ -803,6 +891,77 @@ void MainWindow::on_pbAccelCoast_clicked()
     ui->torqueDemand->setText(torque);
 }
 
+//fields that change the warm up or the model, the rest only affect how it is run or recorded
+bool MainWindow::isModelField(QLineEdit *edit)
+{
+    return edit != ui->runTime && edit != ui->torqueDemand && edit != ui->LiveRatio && edit != ui->LiveHistory && edit != ui->Trigger;
+}
+
+//the same settings that invalidate the snapshots identify a saved warm up state
+QByteArray MainWindow::warmStartKey(void)
+{
+    QByteArray key;
+    QDataStream out(&key, QIODevice::WriteOnly);
+    QMap<QString, QString> fields; //sorted by name so the key doesn't depend on widget order
+    foreach(QLineEdit *edit, findChildren<QLineEdit *>())
+    {
+        if(isModelField(edit))
+            fields[edit->objectName()] = edit->text();
+    }
+    out << fields;
+    out << ui->ExtraCycleDelay->isChecked() << ui->ThrotRamps->isChecked() << ui->DynoMode->isChecked();
+    return key;
+}
+
+void MainWindow::on_pbSnapshot_clicked()
+{
+    delete branchSnapshot;
+    branchSnapshot = engine->Snapshot();
+    branchCount = recorder->discarded() + recorder->count();
+    ui->pbBranch->setEnabled(true);
+}
+
+//go back to the snapshot, the traces up to it are kept so the new branch can be compared with what went before
+void MainWindow::on_pbBranch_clicked()
+{
+    if(!branchSnapshot)
+        return;
+    if(!engine->Restore(branchSnapshot))
+    {
+        ui->statusBar->showMessage("Branch snapshot doesn't fit this firmware build");
+        return;
+    }
+    recorder->truncate(int(qMax(qint64(0), branchCount - recorder->discarded()))); //everything if the branch point has scrolled out of a live history
+    updateGraphs();
+}
+
+void MainWindow::on_pbMap_clicked()
+{
+    QString fileName = QFileDialog::getOpenFileName(this, "Open Efficiency Map", QString(), "Map CSV (*.csv);;All files (*)");
+    if(fileName.isEmpty())
+        return;
+
+    MapView *view = new MapView(this);
+    view->setAttribute(Qt::WA_DeleteOnClose);
+    if(!view->loadFile(fileName))
+    {
+        QMessageBox::warning(this, "Efficiency Map", "Not an efficiency map: " + fileName);
+        delete view;
+        return;
+    }
+    view->show();
+}
+
+//snapshots hold the settings they were taken with so are useless once one changes
+void MainWindow::invalidateSnapshots()
+{
+    delete restartSnapshot;
+    restartSnapshot = nullptr;
+    delete branchSnapshot;
+    branchSnapshot = nullptr;
+    ui->pbBranch->setEnabled(false);
+}
+
 void MainWindow::on_cb_OpPoint_toggled(bool checked)
 {
     if(checked)
@@ -880,19 +1039,38 @@ void MainWindow::on_cb_PowTorqTime_toggled(bool checked)
         powerGraph->hide();
 }
 
+void MainWindow::on_cb_FastPlot_toggled(bool checked)
+{
+    motorGraph->setFastPlot(checked);
+    simulationGraph->setFastPlot(checked);
+    controllerGraph->setFastPlot(checked);
+    debugGraph->setFastPlot(checked);
+    voltageGraph->setFastPlot(checked);
+    idigGraph->setFastPlot(checked);
+    powerGraph->setFastPlot(checked);
+}
+
 void MainWindow::on_rb_Speed_toggled(bool checked)
 {
     powerGraph->clearData(); //need to restart as data arrays not right for new mode
     if(checked)
+    {
         powerGraph->setAxisText("Shaft Speed (rpm)", "Power (kW)", "Torque (Nm)");
+        bindPowerGraph(TR_SHAFT_RPM);
+    }
     else
+    {
         powerGraph->setAxisText("Time (s)", "Power (kW)", "Torque (Nm)");
+        bindPowerGraph(TR_TIME);
+    }
+    applyLiveHistory(); //only scrolls against time
 }
 
 void MainWindow::on_RoadGradient_editingFinished()
 {
     m_roadGradient = ui->RoadGradient->text().toDouble()/100.0; //entered in %
-    motor->setRoadGradient(m_roadGradient);
+    double val = m_roadGradient;
+    apply([=]{motor->setRoadGradient(val);});
 }
 
 void MainWindow::on_runTime_editingFinished()
@@ -907,17 +1085,35 @@ void MainWindow::on_runTime_editingFinished()
 
 void MainWindow::on_VLimMargin_editingFinished()
 {
-    Param::Set(Param::vlimmargin, FP_FROMINT(ui->VLimMargin->text().toInt()));
+    int val = ui->VLimMargin->text().toInt();
+    apply([=]{Param::Set(Param::vlimmargin, FP_FROMINT(val));});
 }
 
 void MainWindow::on_VLimFlt_editingFinished()
 {
-    Param::Set(Param::vlimflt, FP_FROMINT(ui->VLimFlt->text().toInt()));
+    int val = ui->VLimFlt->text().toInt();
+    apply([=]{Param::Set(Param::vlimflt, FP_FROMINT(val));});
 }
 
 void MainWindow::on_FWCurrMax_editingFinished()
 {
-    Param::Set(Param::fwcurmax, FP_FROMINT(ui->FWCurrMax->text().toInt()));
+    int val = ui->FWCurrMax->text().toInt();
+    apply([=]{Param::Set(Param::fwcurmax, FP_FROMINT(val));});
+}
+
+void MainWindow::on_DynoMode_toggled(bool)
+{
+    applyDyno();
+}
+
+void MainWindow::on_DynoSpeed_editingFinished()
+{
+    applyDyno();
+}
+
+void MainWindow::on_DynoRamp_editingFinished()
+{
+    applyDyno();
 }
 
 void MainWindow::on_rb_OP_Amps_toggled(bool checked)
@@ -927,11 +1123,13 @@ void MainWindow::on_rb_OP_Amps_toggled(bool checked)
     {
         idigGraph->setAxisText("Id (A)", "Iq (A)", "");
         idigGraph->updateSeries("I (A)", left, IDIQAMPS);
+        idigGraph->bindSeries(IDIQAMPS, recorder, TR_IQ, TR_ID);
     }
     else
     {
         idigGraph->setAxisText("Vd (V)", "Vq (V)", "");
         idigGraph->updateSeries("V (V)", left, IDIQAMPS);
+        idigGraph->bindSeries(IDIQAMPS, recorder, TR_VQ, TR_VD);
     }
 }
 
@@ -21,9 +21,16 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QTimer>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QElapsedTimer>
+#include <functional>
 #include "datagraph.h"
 #include "idiqgraph.h"
 #include "motormodel.h"
+#include "simengine.h"
+#include "simworker.h"
 
 
 
@@ -37,6 +44,21 @@ class MainWindow : public QMainWindow
 
 private:
     void runFor(int num_steps);
+    void startRun(void);
+    void finishRun(void);
+    void setControlsEnabled(bool enabled);
+    void apply(std::function<void(void)> change);
+    void queueLive(void);
+    void applyLiveHistory(void);
+    RunConfig runOptions(void);
+    void applyRunOptions(void);
+    void applyDyno(void);
+    void updateSubscriptions(void);
+    void updateGraphs(void);
+    QByteArray warmStartKey(void);
+    bool isModelField(QLineEdit *edit);
+    TriggerCapture *activeTrigger(void);
+    void bindPowerGraph(int xChannel);
     void calcFluxLinkage(void);
 
     DataGraph *motorGraph;
@@ -46,13 +68,16 @@ private:
     DataGraph *voltageGraph;
     IdIqGraph *idigGraph;
     DataGraph *powerGraph;
-    MotorModel *motor;
-    double m_time;
-    uint32_t m_old_time;
-    uint32_t m_old_ms_time;
-    double m_oldVa;
-    double m_oldVb;
-    double m_oldVc;
+    SimEngine *engine;
+    MotorModel *motor; //owned by engine
+    SimWorker *worker; //runs the engine, owns it and the firmware Params while busy
+    QTimer *frameTimer; //collects the worker's traces and redraws while a run is going
+    QProgressBar *runProgress;
+    QPushButton *pbCancel;
+    TraceRecorder *recorder;
+    SimSnapshot *restartSnapshot; //state after the start up warm up, reused by restart until a setting changes
+    SimSnapshot *branchSnapshot;
+    qint64 branchCount; //trace rows recorded when the branch snapshot was taken, counting any discarded since
 
     double m_wheelSize;
     double m_vehicleWeight;
@@ -70,7 +95,11 @@ private:
     double m_Vdc;
 
     double m_runTime;
-    int m_lastTorqueDemand;
+
+    QElapsedTimer m_liveClock;
+    double m_liveSteps; //steps of real time not yet queued while live
+    TriggerCapture m_trigger; //used by the worker while it runs
+    int m_flightDumps; //flight recorder dumps already reported
 
 public:
     explicit MainWindow(QWidget *parent = nullptr);
@@ -143,6 +172,30 @@ private slots:
 
     void on_pbAccelCoast_clicked();
 
+    void on_pbSnapshot_clicked();
+
+    void on_pbBranch_clicked();
+
+    void on_pbMap_clicked();
+
+    void on_DynoMode_toggled(bool checked);
+
+    void on_DynoSpeed_editingFinished();
+
+    void on_DynoRamp_editingFinished();
+
+    void invalidateSnapshots();
+
+    void frameTick();
+
+    void cancelRun();
+
+    void on_cb_Live_toggled(bool checked);
+
+    void on_LiveHistory_editingFinished();
+
+    void on_Trigger_editingFinished();
+
     void on_cb_OpPoint_toggled(bool checked);
 
     void on_cb_Simulation_toggled(bool checked);
@@ -157,6 +210,8 @@ private slots:
 
     void on_cb_PowTorqTime_toggled(bool checked);
 
+    void on_cb_FastPlot_toggled(bool checked);
+
     void on_rb_Speed_toggled(bool checked);
 
     void on_RoadGradient_editingFinished();
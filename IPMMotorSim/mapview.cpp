@@ -0,0 +1,297 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "mapview.h"
+#include <QComboBox>
+#include <QToolBar>
+#include <QPainter>
+#include <QMouseEvent>
+#include <QToolTip>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QtMath>
+#include <limits>
+#include <algorithm>
+
+#define MAP_MARGIN_LEFT 70
+#define MAP_MARGIN_RIGHT 90 //room for the colour bar
+#define MAP_MARGIN_TOP 20
+#define MAP_MARGIN_BOTTOM 50
+#define MAP_CONTOURS 10 //roughly, rounded to a tidy step
+
+MapPlot::MapPlot(QWidget *parent) : QWidget(parent), m_minZ{0}, m_maxZ{0}
+{
+    setMouseTracking(true);
+    setMinimumSize(400, 300);
+}
+
+void MapPlot::setData(const QVector<double> &x, const QVector<double> &y, const QVector<double> &z, QString xLabel, QString yLabel, QString zLabel)
+{
+    m_x = x;
+    m_y = y;
+    m_z = z;
+    m_xLabel = xLabel;
+    m_yLabel = yLabel;
+    m_zLabel = zLabel;
+
+    m_minZ = std::numeric_limits<double>::max();
+    m_maxZ = std::numeric_limits<double>::lowest();
+    for(double v : m_z)
+    {
+        if(qIsNaN(v))
+            continue;
+        if(v < m_minZ) m_minZ = v;
+        if(v > m_maxZ) m_maxZ = v;
+    }
+    update();
+}
+
+//blue for the lowest value through to red for the highest
+QColor MapPlot::colourFor(double value)
+{
+    double range = m_maxZ - m_minZ;
+    double f = (range > 0) ? (value - m_minZ) / range : 0.5;
+    return QColor::fromHsvF((1.0 - qBound(0.0, f, 1.0)) * (240.0 / 360.0), 0.85, 0.95);
+}
+
+QPointF MapPlot::toScreen(double x, double y)
+{
+    double xRange = (m_x.last() > m_x.first()) ? (m_x.last() - m_x.first()) : 1;
+    double yRange = (m_y.last() > m_y.first()) ? (m_y.last() - m_y.first()) : 1;
+    return QPointF(m_area.left() + (((x - m_x.first()) / xRange) * m_area.width()),
+                   m_area.bottom() - (((y - m_y.first()) / yRange) * m_area.height()));
+}
+
+void MapPlot::paintEvent(QPaintEvent *)
+{
+    QPainter painter(this);
+    painter.fillRect(rect(), Qt::white);
+    if(m_x.isEmpty() || m_y.isEmpty() || m_minZ > m_maxZ)
+    {
+        painter.drawText(rect(), Qt::AlignCenter, "No data");
+        return;
+    }
+
+    m_area = QRectF(MAP_MARGIN_LEFT, MAP_MARGIN_TOP, width() - MAP_MARGIN_LEFT - MAP_MARGIN_RIGHT, height() - MAP_MARGIN_TOP - MAP_MARGIN_BOTTOM);
+    int nx = m_x.size();
+    int ny = m_y.size();
+
+    //one cell per point, edges half way to the neighbours
+    for(int j = 0; j < ny; j++)
+    {
+        for(int i = 0; i < nx; i++)
+        {
+            double z = m_z[(j * nx) + i];
+            if(qIsNaN(z))
+                continue;
+            double x0 = (i > 0) ? (m_x[i - 1] + m_x[i]) / 2 : m_x[i];
+            double x1 = (i < nx - 1) ? (m_x[i] + m_x[i + 1]) / 2 : m_x[i];
+            double y0 = (j > 0) ? (m_y[j - 1] + m_y[j]) / 2 : m_y[j];
+            double y1 = (j < ny - 1) ? (m_y[j] + m_y[j + 1]) / 2 : m_y[j];
+            QRectF cell(toScreen(x0, y1), toScreen(x1, y0));
+            if(nx == 1) cell.setWidth(m_area.width());
+            if(ny == 1) cell.setHeight(m_area.height());
+            painter.fillRect(cell.normalized(), colourFor(z));
+        }
+    }
+
+    //contours at a tidy 1, 2 or 5 step
+    double range = m_maxZ - m_minZ;
+    if(range > 0 && nx > 1 && ny > 1)
+    {
+        double step = qPow(10.0, qFloor(log10(range / MAP_CONTOURS)));
+        if(range / step > MAP_CONTOURS * 5) step *= 5;
+        else if(range / step > MAP_CONTOURS * 2) step *= 2;
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.setPen(QPen(Qt::black, 1));
+        for(double level = qCeil(m_minZ / step) * step; level <= m_maxZ; level += step)
+            drawContour(painter, level);
+        painter.setRenderHint(QPainter::Antialiasing, false);
+    }
+
+    //axes
+    painter.setPen(Qt::black);
+    painter.drawRect(m_area);
+    QFontMetrics fm(font());
+    int xEvery = qMax(1, (nx * fm.horizontalAdvance("00000")) / qMax(int(m_area.width()), 1) + 1);
+    for(int i = 0; i < nx; i += xEvery)
+    {
+        QPointF p = toScreen(m_x[i], m_y.first());
+        painter.drawLine(p, p + QPointF(0, 4));
+        painter.drawText(QRectF(p.x() - 40, m_area.bottom() + 6, 80, fm.height()), Qt::AlignHCenter, QString::number(m_x[i]));
+    }
+    int yEvery = qMax(1, (ny * fm.height()) / qMax(int(m_area.height()), 1) + 1);
+    for(int j = 0; j < ny; j += yEvery)
+    {
+        QPointF p = toScreen(m_x.first(), m_y[j]);
+        painter.drawLine(p, p - QPointF(4, 0));
+        painter.drawText(QRectF(0, p.y() - fm.height() / 2, MAP_MARGIN_LEFT - 8, fm.height()), Qt::AlignRight, QString::number(m_y[j]));
+    }
+    painter.drawText(QRectF(m_area.left(), height() - fm.height() - 4, m_area.width(), fm.height()), Qt::AlignHCenter, m_xLabel);
+    painter.save();
+    painter.translate(fm.height(), m_area.center().y());
+    painter.rotate(-90);
+    painter.drawText(QRectF(-m_area.height() / 2, -fm.height(), m_area.height(), fm.height()), Qt::AlignHCenter, m_yLabel);
+    painter.restore();
+
+    //colour bar
+    QRectF bar(m_area.right() + 15, m_area.top(), 20, m_area.height());
+    for(int y = 0; y < int(bar.height()); y++)
+        painter.fillRect(QRectF(bar.left(), bar.bottom() - y - 1, bar.width(), 1), colourFor(m_minZ + ((m_maxZ - m_minZ) * y / bar.height())));
+    painter.drawRect(bar);
+    painter.drawText(QPointF(bar.right() + 4, bar.top() + fm.ascent()), QString::number(m_maxZ, 'g', 4));
+    painter.drawText(QPointF(bar.right() + 4, bar.bottom()), QString::number(m_minZ, 'g', 4));
+    painter.drawText(QRectF(bar.left() - 10, 0, MAP_MARGIN_RIGHT, MAP_MARGIN_TOP), Qt::AlignLeft, m_zLabel);
+}
+
+//marching squares over the grid points, squares with a missing corner are skipped
+void MapPlot::drawContour(QPainter &painter, double level)
+{
+    int nx = m_x.size();
+    for(int j = 0; j < m_y.size() - 1; j++)
+    {
+        for(int i = 0; i < nx - 1; i++)
+        {
+            double x[4] = {m_x[i], m_x[i + 1], m_x[i + 1], m_x[i]};
+            double y[4] = {m_y[j], m_y[j], m_y[j + 1], m_y[j + 1]};
+            double z[4] = {m_z[(j * nx) + i], m_z[(j * nx) + i + 1], m_z[((j + 1) * nx) + i + 1], m_z[((j + 1) * nx) + i]};
+            if(qIsNaN(z[0]) || qIsNaN(z[1]) || qIsNaN(z[2]) || qIsNaN(z[3]))
+                continue;
+
+            QPointF crossings[4];
+            int n = 0;
+            for(int e = 0; e < 4; e++)
+            {
+                int a = e, b = (e + 1) % 4;
+                if((z[a] < level) != (z[b] < level))
+                {
+                    double t = (level - z[a]) / (z[b] - z[a]);
+                    crossings[n++] = toScreen(x[a] + (t * (x[b] - x[a])), y[a] + (t * (y[b] - y[a])));
+                }
+            }
+            if(n >= 2)
+                painter.drawLine(crossings[0], crossings[1]);
+            if(n == 4) //saddle, pair the other two edges
+                painter.drawLine(crossings[2], crossings[3]);
+        }
+    }
+}
+
+void MapPlot::mouseMoveEvent(QMouseEvent *event)
+{
+    if(m_x.isEmpty() || m_y.isEmpty() || !m_area.contains(event->pos()))
+        return;
+
+    //nearest grid point
+    int bi = 0, bj = 0;
+    double best = std::numeric_limits<double>::max();
+    for(int j = 0; j < m_y.size(); j++)
+    {
+        for(int i = 0; i < m_x.size(); i++)
+        {
+            QPointF d = toScreen(m_x[i], m_y[j]) - event->pos();
+            double dist = QPointF::dotProduct(d, d);
+            if(dist < best)
+            {
+                best = dist;
+                bi = i;
+                bj = j;
+            }
+        }
+    }
+    double z = m_z[(bj * m_x.size()) + bi];
+    QToolTip::showText(event->globalPos(), QString("%1 %2, %3 %4\n%5 %6").arg(m_xLabel).arg(m_x[bi]).arg(m_yLabel).arg(m_y[bj])
+                       .arg(m_zLabel).arg(qIsNaN(z) ? QString("-") : QString::number(z)), this);
+}
+
+MapView::MapView(QWidget *parent) : QMainWindow(parent)
+{
+    m_plot = new MapPlot(this);
+    setCentralWidget(m_plot);
+
+    m_metric = new QComboBox(this);
+    QToolBar *toolbar = addToolBar("Map");
+    toolbar->addWidget(m_metric);
+    connect(m_metric, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &MapView::selectMetric);
+    resize(800, 600);
+}
+
+//index,speed_rpm,torque_demand,<metrics>,status with the torque axis varying fastest
+bool MapView::loadFile(const QString &fileName)
+{
+    QFile file(fileName);
+    if(!file.open(QFile::ReadOnly | QFile::Text))
+        return false;
+
+    QTextStream in(&file);
+    QStringList header = in.readLine().split(',');
+    if(header.size() < 5 || header[1] != "speed_rpm" || header[2] != "torque_demand")
+        return false;
+    m_names = header.mid(3, header.size() - 4);
+
+    QList<QStringList> rows;
+    m_speeds.clear();
+    m_torques.clear();
+    while(!in.atEnd())
+    {
+        QStringList row = in.readLine().split(',');
+        if(row.size() != header.size())
+            continue;
+        double speed = row[1].toDouble();
+        double torque = row[2].toDouble();
+        if(!m_speeds.contains(speed)) m_speeds.append(speed);
+        if(!m_torques.contains(torque)) m_torques.append(torque);
+        rows.append(row);
+    }
+    if(rows.isEmpty())
+        return false;
+    std::sort(m_speeds.begin(), m_speeds.end());
+    std::sort(m_torques.begin(), m_torques.end());
+
+    m_grids.fill(QVector<double>(m_speeds.size() * m_torques.size(), qQNaN()), m_names.size());
+    for(const QStringList &row : rows)
+    {
+        int i = m_speeds.indexOf(row[1].toDouble());
+        int j = m_torques.indexOf(row[2].toDouble());
+        for(int m = 0; m < m_names.size(); m++)
+        {
+            bool ok;
+            double v = row[m + 3].toDouble(&ok);
+            if(ok)
+                m_grids[m][(j * m_speeds.size()) + i] = v;
+        }
+    }
+
+    setWindowTitle("Efficiency Map - " + QFileInfo(fileName).fileName());
+    m_metric->clear();
+    m_metric->addItems(m_names);
+    int efficiency = m_names.indexOf("efficiency");
+    m_metric->setCurrentIndex(qMax(efficiency, 0));
+    selectMetric(m_metric->currentIndex());
+    return true;
+}
+
+void MapView::selectMetric(int index)
+{
+    if(index < 0 || index >= m_grids.size())
+        return;
+    m_plot->setData(m_speeds, m_torques, m_grids[index], "Speed (rpm)", "Torque demand (%)", m_names[index]);
+}
@@ -0,0 +1,73 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MAPVIEW_H
+#define MAPVIEW_H
+
+#include <QMainWindow>
+#include <QVector>
+#include <QStringList>
+
+class QComboBox;
+
+//Heatmap with contour lines of one value over a regular x/y grid, missing points are NaN
+class MapPlot : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit MapPlot(QWidget *parent = nullptr);
+    void setData(const QVector<double> &x, const QVector<double> &y, const QVector<double> &z, QString xLabel, QString yLabel, QString zLabel);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+
+private:
+    QColor colourFor(double value);
+    QPointF toScreen(double x, double y);
+    void drawContour(QPainter &painter, double level);
+
+    QVector<double> m_x, m_y;
+    QVector<double> m_z; //row per y value
+    QString m_xLabel, m_yLabel, m_zLabel;
+    double m_minZ, m_maxZ;
+    QRectF m_area; //plot area of the last paint
+};
+
+//Viewer for the CSV written by the command line runner's --map option
+class MapView : public QMainWindow
+{
+    Q_OBJECT
+public:
+    explicit MapView(QWidget *parent = nullptr);
+    bool loadFile(const QString &fileName);
+
+private slots:
+    void selectMetric(int index);
+
+private:
+    QComboBox *m_metric;
+    MapPlot *m_plot;
+    QVector<double> m_speeds, m_torques;
+    QStringList m_names;
+    QVector<QVector<double>> m_grids; //per metric, row per torque value
+};
+
+#endif // MAPVIEW_H
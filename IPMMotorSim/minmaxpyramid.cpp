@@ -0,0 +1,150 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "minmaxpyramid.h"
+#include <QtMath>
+
+MinMaxPyramid::MinMaxPyramid()
+    :m_count{0}
+{
+}
+
+void MinMaxPyramid::Clear(void)
+{
+    m_levels.clear();
+    m_count = 0;
+}
+
+void MinMaxPyramid::Merge(Block &block, const Block &other) const
+{
+    if(other.iMin < 0)
+        return;
+    if(block.iMin < 0 || other.min < block.min)
+    {
+        block.min = other.min;
+        block.iMin = other.iMin;
+    }
+    if(block.iMax < 0 || other.max > block.max)
+    {
+        block.max = other.max;
+        block.iMax = other.iMax;
+    }
+}
+
+//add rows recorded since the last update, a shorter column starts again
+//rows changed in place (a truncated recorder that has grown again) aren't seen, the owner must Clear() on TraceRecorder::generation()
+void MinMaxPyramid::Update(const TraceValue *y, int count)
+{
+    if(count < m_count)
+        Clear();
+    if(count == m_count)
+        return;
+
+    const Block empty = {0, 0, -1, -1};
+    int first = m_count; //first new row
+    int blockRows = 1;
+    for(int level = 0; count > blockRows; level++)
+    {
+        blockRows *= PYRAMID_FANOUT;
+        if(level >= m_levels.size())
+            m_levels.append(QVector<Block>());
+        QVector<Block> &blocks = m_levels[level];
+        int firstBlock = first / blockRows;
+        int lastBlock = (count - 1) / blockRows;
+        blocks.resize(lastBlock + 1);
+
+        //rebuild each changed block from its children, the rows themselves for level 1
+        for(int b = firstBlock; b <= lastBlock; b++)
+        {
+            Block block = empty;
+            int start = b * PYRAMID_FANOUT;
+            if(level == 0)
+            {
+                for(int i = start; i < qMin(start + PYRAMID_FANOUT, count); i++)
+                {
+                    if(!qIsNaN(y[i]))
+                        Merge(block, {y[i], y[i], i, i});
+                }
+            }
+            else
+            {
+                const QVector<Block> &children = m_levels[level - 1];
+                for(int c = start; c < qMin(start + PYRAMID_FANOUT, children.size()); c++)
+                    Merge(block, children[c]);
+            }
+            blocks[b] = block;
+        }
+    }
+    m_count = count;
+}
+
+//rows of the min and max for each of about columns buckets across rows [first, last), in row order
+//buckets are made of whole blocks of the coarsest level that still gives enough of them
+void MinMaxPyramid::Query(const TraceValue *y, int first, int last, int columns, QVector<int> &rows) const
+{
+    rows.clear();
+    last = qMin(last, m_count);
+    int count = last - first;
+    if(count <= 0)
+        return;
+    int bucketRows = qMax(1, count / qMax(columns, 1));
+
+    if(bucketRows <= 2) //no more than two points a column anyway
+    {
+        rows.reserve(count);
+        for(int i = first; i < last; i++)
+        {
+            if(!qIsNaN(y[i]))
+                rows.append(i);
+        }
+        return;
+    }
+
+    int level = 0; //0 is the rows themselves
+    int blockRows = 1;
+    while(level < m_levels.size() && blockRows * PYRAMID_FANOUT <= bucketRows)
+    {
+        level++;
+        blockRows *= PYRAMID_FANOUT;
+    }
+    int perBucket = bucketRows / blockRows;
+    int firstBlock = first / blockRows;
+    int lastBlock = (last - 1) / blockRows;
+
+    rows.reserve(2 * (((lastBlock - firstBlock) / perBucket) + 1));
+    for(int b = firstBlock; b <= lastBlock; b += perBucket)
+    {
+        Block bucket = {0, 0, -1, -1};
+        for(int c = b; c < qMin(b + perBucket, lastBlock + 1); c++)
+        {
+            if(level > 0)
+                Merge(bucket, m_levels[level - 1][c]);
+            else if(!qIsNaN(y[c]))
+                Merge(bucket, {y[c], y[c], c, c});
+        }
+        if(bucket.iMin < 0)
+            continue;
+        int a = qMin(bucket.iMin, bucket.iMax);
+        int z = qMax(bucket.iMin, bucket.iMax);
+        rows.append(a);
+        if(z != a)
+            rows.append(z);
+    }
+}
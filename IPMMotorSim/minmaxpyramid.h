@@ -0,0 +1,51 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MINMAXPYRAMID_H
+#define MINMAXPYRAMID_H
+
+#include <QVector>
+#include "tracerecorder.h"
+
+#define PYRAMID_FANOUT 8 //rows per level 1 block, level 1 blocks per level 2 block and so on
+
+//Min/max index over one recorder column at several resolutions, level n blocks cover PYRAMID_FANOUT^n rows
+//Built incrementally as rows are recorded so a query for any row range costs about its output size
+class MinMaxPyramid
+{
+public:
+    MinMaxPyramid();
+    void Clear(void);
+    void Update(const TraceValue *y, int count);
+    void Query(const TraceValue *y, int first, int last, int columns, QVector<int> &rows) const;
+
+private:
+    struct Block
+    {
+        double min, max;
+        int iMin, iMax; //rows of the extremes, -1 if the block only has NaN rows
+    };
+    void Merge(Block &block, const Block &other) const;
+
+    QVector<QVector<Block>> m_levels; //m_levels[0] is level 1
+    int m_count; //rows included so far
+};
+
+#endif // MINMAXPYRAMID_H
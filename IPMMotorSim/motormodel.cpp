@@ -19,9 +19,26 @@
 
 #include "motormodel.h"
 
+#define PHASOR_RESYNC_STEPS 1024 //phasor recalculated from m_Position this often to stop rounding errors accumulating
+#define SMALL_ANGLE_MAX 0.25 //radians, larger rotations fall back to sin/cos
+
+//sin and cos of a small angle from their series, good to better than 1e-12 below SMALL_ANGLE_MAX
+static inline bool smallAngleTrig(double angle, double &c, double &s)
+{
+    if(qAbs(angle) > SMALL_ANGLE_MAX)
+        return false;
+    double a2 = angle * angle;
+    c = 1.0 - (a2/2.0)*(1.0 - (a2/12.0)*(1.0 - (a2/30.0)*(1.0 - (a2/56.0))));
+    s = angle*(1.0 - (a2/6.0)*(1.0 - (a2/20.0)*(1.0 - (a2/42.0)*(1.0 - (a2/72.0)))));
+    return true;
+}
+
 MotorModel::MotorModel(double wheelSize,double ratio,double roadGradient,double mass,double Lq,double Ld,double Rs,double poles,double fluxLink,double timestep, double syncDelay, double sampPoint)
-    :m_WheelSize{wheelSize},m_Ratio{ratio},m_RoadGradient{roadGradient},m_Mass{mass},m_Lq{Lq},m_Ld{Ld},m_Rs{Rs},m_Poles{poles},m_FluxLink{fluxLink}, m_syncdelay{syncDelay}, m_samplingPoint{sampPoint}, m_Timestep{timestep}
+    :m_WheelSize{wheelSize},m_Ratio{ratio},m_RoadGradient{roadGradient},m_Mass{mass},m_Lq{Lq},m_Ld{Ld},m_Rs{Rs},m_Poles{poles},m_FluxLink{fluxLink}, m_syncdelay{syncDelay}, m_samplingPoint{sampPoint}, m_Timestep{timestep},
+      m_Dyno{false}, m_DynoStart{0}, m_DynoSpeed{0}, m_DynoTarget{0}, m_DynoRate{0},
+      m_MechDivider{1}, m_MechInterp{false}, m_Integrator{INTEG_EULER}, m_TrigMode{TRIG_REFERENCE}, m_TrigCheck{false}, m_TrigMaxError{0}
 {
+    UpdateConstants();
     Restart();
 }
 
@@ -30,6 +47,10 @@ void MotorModel::Restart(void)
     m_Position = 0;
     m_Frequency = 0;
     m_Speed = 0;
+    m_MechSpeed = 0;
+    m_Accel = 0;
+    m_TorqueSum = 0;
+    m_MechCount = 0;
     m_Ia = 0;
     m_Ib = 0;
     m_Ic = 0;
@@ -40,6 +61,40 @@ void MotorModel::Restart(void)
     m_Iq = 0;
     m_Power = 0;
     m_Torque = 0;
+    ResetPhasor();
+    if(m_Dyno)
+    {
+        m_DynoSpeed = m_DynoStart; //run the dyno program again
+        setShaftSpeed(m_DynoSpeed);
+    }
+}
+
+//terms that only depend on parameters, sin(atan(g)) = g/sqrt(1+g^2)
+void MotorModel::UpdateConstants(void)
+{
+    m_GradientForce = -(m_RoadGradient/qSqrt(1.0 + (m_RoadGradient*m_RoadGradient)))*m_Mass*9.81;
+    m_PolesRad = m_Poles * 2 * M_PI;
+}
+
+void MotorModel::ResetPhasor(void)
+{
+    PositionTrig(m_Position, m_PhasorCos, m_PhasorSin);
+    m_PhasorSteps = 0;
+}
+
+//single sin/cos pair for an angle, the compiler merges these into one sincos call
+void MotorModel::PositionTrig(double position, double &cosPos, double &sinPos)
+{
+    double rad = qDegreesToRadians(position);
+    cosPos = qCos(rad);
+    sinPos = qSin(rad);
+}
+
+void MotorModel::CheckTrig(double position, double cosPos, double sinPos)
+{
+    double err = qMax(qAbs(cosPos - qCos(qDegreesToRadians(position))), qAbs(sinPos - qSin(qDegreesToRadians(position))));
+    if(err > m_TrigMaxError)
+        m_TrigMaxError = err;
 }
 
 void MotorModel::Step(double Va, double Vb, double Vc)
@@ -48,10 +103,33 @@ void MotorModel::Step(double Va, double Vb, double Vc)
     double Valpha = Va;
     double Vbeta = ((Va+(2.0*Vb))/qSqrt(3.0));
 
-    double elecAngle = fmod(m_Position,360.0);
+    //m_Position and elecAngle are the same angle, the reference path keeps the original mix of the two
+    double cosPos, sinPos, cosElec, sinElec;
+    if(m_TrigMode == TRIG_REFERENCE)
+    {
+        double elecAngle = fmod(m_Position,360.0);
+        cosPos = qCos(qDegreesToRadians(m_Position));
+        sinPos = qSin(qDegreesToRadians(m_Position));
+        cosElec = qCos(qDegreesToRadians(elecAngle));
+        sinElec = qSin(qDegreesToRadians(elecAngle));
+    }
+    else
+    {
+        if(m_TrigMode == TRIG_PHASOR)
+        {
+            cosPos = m_PhasorCos;
+            sinPos = m_PhasorSin;
+        }
+        else
+            PositionTrig(m_Position, cosPos, sinPos);
+        cosElec = cosPos;
+        sinElec = sinPos;
+        if(m_TrigCheck)
+            CheckTrig(m_Position, cosPos, sinPos);
+    }
 
-    m_Vd = (Valpha * qCos(qDegreesToRadians(m_Position))) + (Vbeta * qSin(qDegreesToRadians(elecAngle)));
-    m_Vq = (-Valpha * qSin(qDegreesToRadians(m_Position))) + (Vbeta * qCos(qDegreesToRadians(elecAngle)));
+    m_Vd = (Valpha * cosPos) + (Vbeta * sinElec);
+    m_Vq = (-Valpha * sinPos) + (Vbeta * cosElec);
 
     m_Vq_bemf = m_FluxLink * m_Poles * m_Frequency * 2 * M_PI;
     m_Vq_dueto_id = m_Poles * m_Frequency * 2 * M_PI * m_Ld * m_Id;
@@ -64,18 +142,32 @@ void MotorModel::Step(double Va, double Vb, double Vc)
     m_VLq = m_Vq - m_Vq_dueto_Rq - m_Vq_bemf - m_Vq_dueto_id;
 
     //variables to allow for values to be read at a variable sampling point to simulate non ideal behaviour of real controllers
-    double IdSamp = m_Id + (m_VLd * m_Timestep * m_samplingPoint)/m_Ld;
-    double IqSamp = m_Iq + (m_VLq * m_Timestep * m_samplingPoint)/m_Lq;
+    double IdSamp, IqSamp;
     double oldPosition = m_Position;
 
-    double Id_delta = (m_VLd * m_Timestep)/m_Ld;
-    double Iq_delta = (m_VLq * m_Timestep)/m_Lq;
+    if(m_Integrator == INTEG_EULER)
+    {
+        IdSamp = m_Id + (m_VLd * m_Timestep * m_samplingPoint)/m_Ld;
+        IqSamp = m_Iq + (m_VLq * m_Timestep * m_samplingPoint)/m_Lq;
 
-    m_Id = m_Id + Id_delta;
-    m_Iq = m_Iq + Iq_delta;
+        double Id_delta = (m_VLd * m_Timestep)/m_Ld;
+        double Iq_delta = (m_VLq * m_Timestep)/m_Lq;
 
-    double Ialpha = (m_Id * qCos(qDegreesToRadians(elecAngle))) - (m_Iq * qSin(qDegreesToRadians(elecAngle)));
-    double Ibeta = (m_Id * qSin(qDegreesToRadians(elecAngle))) + (m_Iq * qCos(qDegreesToRadians(elecAngle)));
+        m_Id = m_Id + Id_delta;
+        m_Iq = m_Iq + Iq_delta;
+    }
+    else
+    {
+        double we = m_Poles * m_Frequency * 2 * M_PI;
+        IdSamp = m_Id;
+        IqSamp = m_Iq;
+        if(m_samplingPoint > 0)
+            Integrate(m_Timestep * m_samplingPoint, m_Vd, m_Vq, we, IdSamp, IqSamp);
+        Integrate(m_Timestep, m_Vd, m_Vq, we, m_Id, m_Iq);
+    }
+
+    double Ialpha = (m_Id * cosElec) - (m_Iq * sinElec);
+    double Ibeta = (m_Id * sinElec) + (m_Iq * cosElec);
 
     m_Ia = Ialpha;
     m_Ib = (-Ialpha + (qSqrt(3.0) * Ibeta)) / 2.0;
@@ -83,17 +175,18 @@ void MotorModel::Step(double Va, double Vb, double Vc)
 
     m_Torque = (3.0/2.0) * m_Poles * ((m_FluxLink * m_Iq) + ((m_Ld - m_Lq) * m_Id * m_Iq));
 
-    //This is a very simple model just lumping everything together in a single vehicle mass
-    //A better approach would be to have a fast and slow calculation
-    //The slow calculation is pretty much as below and based on car mass
-    //The fast calculation kicks in on direction changes produces a position calculated just from the inertia for the motor and geartrain.  The
-    //position delta from this component would be limited by a configurable driveshaft angular play parameter.
-    //If added this would allow driveline shunt to be simulated by the model
-    double wheelTorque = (m_Torque * m_Ratio) / m_WheelSize;//m_Wheelsize is radius (in m) to give N here
-    double gradientForce = -(qSin(qAtan(m_RoadGradient))*m_Mass*9.81);
-    double accelForce = wheelTorque + gradientForce;
-    double accel = accelForce/m_Mass;
-    m_Speed = m_Speed + (accel * m_Timestep);
+    //mechanical/vehicle side runs every m_MechDivider electrical steps on the average torque over those steps
+    m_TorqueSum += m_Torque;
+    if(++m_MechCount >= m_MechDivider)
+    {
+        StepMechanical(m_TorqueSum / m_MechCount, m_Timestep * m_MechCount);
+        m_TorqueSum = 0;
+        m_MechCount = 0;
+        m_Speed = m_MechSpeed;
+    }
+    else if(m_MechInterp)
+        m_Speed = m_MechSpeed + (m_Accel * m_Timestep * m_MechCount); //extrapolate on the last acceleration
+    //else speed held until the next mechanical step
     m_Frequency = (m_Speed / (2.0 * M_PI * m_WheelSize)) * m_Ratio;
     m_Power = 2.0 * M_PI * m_Frequency * m_Torque;
 
@@ -102,9 +195,41 @@ void MotorModel::Step(double Va, double Vb, double Vc)
 
     //Remaining variable sampling point calculation, used to simulate OpenInverter sampling point (5.20 and earlier)
     double sampPosition = ((oldPosition * (1.0-m_samplingPoint)) + (m_Position * m_samplingPoint));
-    double elecAngleSamp = fmod(sampPosition, 360.0);
-    Ialpha = (IdSamp * qCos(qDegreesToRadians(elecAngleSamp))) - (IqSamp * qSin(qDegreesToRadians(elecAngleSamp)));
-    Ibeta = (IdSamp * qSin(qDegreesToRadians(elecAngleSamp))) + (IqSamp * qCos(qDegreesToRadians(elecAngleSamp)));
+    double cosSamp, sinSamp;
+    if(m_TrigMode == TRIG_REFERENCE)
+    {
+        double elecAngleSamp = fmod(sampPosition, 360.0);
+        cosSamp = qCos(qDegreesToRadians(elecAngleSamp));
+        sinSamp = qSin(qDegreesToRadians(elecAngleSamp));
+    }
+    else if(m_TrigMode == TRIG_PHASOR)
+    {
+        //rotate the phasor on to the sampling point and then the end of the step
+        double deltaRad = m_Frequency * m_Timestep * m_PolesRad;
+        double c, s;
+        if(smallAngleTrig(deltaRad * m_samplingPoint, c, s))
+        {
+            cosSamp = (cosPos * c) - (sinPos * s);
+            sinSamp = (sinPos * c) + (cosPos * s);
+        }
+        else
+            PositionTrig(sampPosition, cosSamp, sinSamp);
+
+        if(++m_PhasorSteps >= PHASOR_RESYNC_STEPS || !smallAngleTrig(deltaRad, c, s))
+            ResetPhasor(); //m_Position is not wrapped yet but that is a whole number of turns
+        else
+        {
+            m_PhasorCos = (cosPos * c) - (sinPos * s);
+            m_PhasorSin = (sinPos * c) + (cosPos * s);
+        }
+    }
+    else
+        PositionTrig(sampPosition, cosSamp, sinSamp);
+    if(m_TrigCheck && m_TrigMode != TRIG_REFERENCE)
+        CheckTrig(sampPosition, cosSamp, sinSamp);
+
+    Ialpha = (IdSamp * cosSamp) - (IqSamp * sinSamp);
+    Ibeta = (IdSamp * sinSamp) + (IqSamp * cosSamp);
 
     m_IaSamp = Ialpha;
     m_IbSamp = (-Ialpha + (qSqrt(3.0) * Ibeta)) / 2.0;
@@ -118,6 +243,187 @@ void MotorModel::Step(double Va, double Vb, double Vc)
 
 }
 
+//This is a very simple model just lumping everything together in a single vehicle mass
+//A better approach would be to have a fast and slow calculation
+//The slow calculation is pretty much as below and based on car mass
+//The fast calculation kicks in on direction changes produces a position calculated just from the inertia for the motor and geartrain.  The
+//position delta from this component would be limited by a configurable driveshaft angular play parameter.
+//If added this would allow driveline shunt to be simulated by the model
+void MotorModel::StepMechanical(double torque, double h)
+{
+    if(m_Dyno)
+    {
+        StepDyno(h);
+        return;
+    }
+
+    double wheelTorque = (torque * m_Ratio) / m_WheelSize;//m_Wheelsize is radius (in m) to give N here
+    double gradientForce;
+    if(m_TrigMode == TRIG_REFERENCE)
+        gradientForce = -(qSin(qAtan(m_RoadGradient))*m_Mass*9.81);
+    else
+        gradientForce = m_GradientForce;
+    double accelForce = wheelTorque + gradientForce;
+    m_Accel = accelForce/m_Mass;
+    m_MechSpeed = m_MechSpeed + (m_Accel * h);
+}
+
+//dyno speed moves towards its target at the programmed rate, the motor torque has no effect
+void MotorModel::StepDyno(double h)
+{
+    double oldSpeed = m_MechSpeed;
+    double step = m_DynoRate * h;
+    if(qAbs(m_DynoTarget - m_DynoSpeed) <= step)
+        m_DynoSpeed = m_DynoTarget;
+    else
+        m_DynoSpeed += (m_DynoTarget > m_DynoSpeed) ? step : -step;
+    m_MechSpeed = ((m_DynoSpeed / 60.0) / m_Ratio) * (2.0 * M_PI * m_WheelSize);
+    m_Accel = (m_MechSpeed - oldSpeed) / h;
+}
+
+void MotorModel::setDynoSpeed(double rpm)
+{
+    m_DynoStart = rpm;
+    m_DynoSpeed = rpm;
+    m_DynoTarget = rpm;
+    m_DynoRate = 0;
+    if(m_Dyno)
+        setShaftSpeed(rpm);
+}
+
+void MotorModel::setDynoRamp(double rpm, double rate)
+{
+    m_DynoStart = m_Dyno ? m_DynoSpeed : (m_Frequency * 60.0);
+    m_DynoSpeed = m_DynoStart;
+    m_DynoTarget = rpm;
+    m_DynoRate = qAbs(rate);
+}
+
+//advance Id/Iq by h seconds with Vd, Vq and electrical speed we (rad/s) held constant
+//  dId/dt = (Vd - Rs*Id + we*Lq*Iq)/Ld
+//  dIq/dt = (Vq - Rs*Iq - we*Ld*Id - we*FluxLink)/Lq
+void MotorModel::Integrate(double h, double Vd, double Vq, double we, double &Id, double &Iq)
+{
+    double Vq_eff = Vq - (we * m_FluxLink);
+
+    switch(m_Integrator)
+    {
+    case INTEG_SEMI_IMPLICIT:
+        Id = (Id + (h * (Vd + (we * m_Lq * Iq)))/m_Ld) / (1.0 + (h * m_Rs)/m_Ld);
+        Iq = (Iq + (h * (Vq_eff - (we * m_Ld * Id)))/m_Lq) / (1.0 + (h * m_Rs)/m_Lq);
+        break;
+
+    case INTEG_RK4:
+    {
+        double kd[4], kq[4];
+        double d = Id, q = Iq;
+        for(int i = 0; i < 4; i++)
+        {
+            kd[i] = (Vd - (m_Rs * d) + (we * m_Lq * q))/m_Ld;
+            kq[i] = (Vq_eff - (m_Rs * q) - (we * m_Ld * d))/m_Lq;
+            double frac = (i == 2) ? h : h/2;
+            d = Id + (frac * kd[i]);
+            q = Iq + (frac * kq[i]);
+        }
+        Id = Id + (h/6.0) * (kd[0] + 2*kd[1] + 2*kd[2] + kd[3]);
+        Iq = Iq + (h/6.0) * (kq[0] + 2*kq[1] + 2*kq[2] + kq[3]);
+        break;
+    }
+
+    case INTEG_EXACT:
+    {
+        //x' = Ax + b, A = sI + N with N traceless so N^2 = -det(N)I and exp(Ah) has a closed form
+        double a11 = -m_Rs/m_Ld, a12 = (we * m_Lq)/m_Ld;
+        double a21 = -(we * m_Ld)/m_Lq, a22 = -m_Rs/m_Lq;
+        double b1 = Vd/m_Ld, b2 = Vq_eff/m_Lq;
+        double sgm = (a11 + a22)/2;
+        double n11 = a11 - sgm;
+        double delta = (n11 * n11) + (a12 * a21); //= -det(N)
+        double ch, sh; //exp(Nh) = ch*I + sh*N
+        if(qAbs(delta * h * h) < 1e-8) //close to critically damped, use the series
+        {
+            ch = 1.0 + (delta * h * h)/2;
+            sh = h * (1.0 + (delta * h * h)/6);
+        }
+        else if(delta > 0)
+        {
+            double r = qSqrt(delta);
+            ch = cosh(r * h);
+            sh = sinh(r * h)/r;
+        }
+        else
+        {
+            double r = qSqrt(-delta);
+            ch = qCos(r * h);
+            sh = qSin(r * h)/r;
+        }
+        double e = qExp(sgm * h);
+        double p11 = e * (ch + (sh * n11)), p12 = e * sh * a12;
+        double p21 = e * sh * a21, p22 = e * (ch - (sh * n11));
+
+        //forced response A^-1 (exp(Ah) - I) b, falls back to h*b when A is singular (no resistance and stationary)
+        double detA = (a11 * a22) - (a12 * a21);
+        double f1, f2;
+        if(qAbs(detA * h * h) > 1e-12)
+        {
+            double g1 = ((p11 - 1.0) * b1) + (p12 * b2);
+            double g2 = (p21 * b1) + ((p22 - 1.0) * b2);
+            f1 = ((a22 * g1) - (a12 * g2))/detA;
+            f2 = ((a11 * g2) - (a21 * g1))/detA;
+        }
+        else
+        {
+            f1 = h * b1;
+            f2 = h * b2;
+        }
+        double d = Id;
+        Id = (p11 * d) + (p12 * Iq) + f1;
+        Iq = (p21 * d) + (p22 * Iq) + f2;
+        break;
+    }
+
+    default: //INTEG_EULER
+    {
+        double dId = (Vd - (m_Rs * Id) + (we * m_Lq * Iq))/m_Ld;
+        double dIq = (Vq_eff - (m_Rs * Iq) - (we * m_Ld * Id))/m_Lq;
+        Id = Id + (h * dId);
+        Iq = Iq + (h * dIq);
+        break;
+    }
+    }
+}
+
+void MotorModel::setShaftSpeed(double rpm)
+{
+    m_Frequency = rpm / 60.0;
+    m_MechSpeed = (m_Frequency / m_Ratio) * (2.0 * M_PI * m_WheelSize);
+    m_Speed = m_MechSpeed;
+    m_TorqueSum = 0;
+    m_MechCount = 0;
+}
+
+//skip ahead from a periodic steady state, shaftAccel in rpm/s
+//the rotor angle is left alone as the waveforms repeat every turn, only the speed moves on
+void MotorModel::FastForward(double duration, double shaftAccel)
+{
+    if(m_Dyno) //the dyno program decides the speed
+    {
+        StepDyno(duration);
+        m_Speed = m_MechSpeed;
+        m_TorqueSum = 0;
+        m_MechCount = 0;
+        m_Frequency = (m_Speed / (2.0 * M_PI * m_WheelSize)) * m_Ratio;
+        return;
+    }
+
+    double accel = ((shaftAccel / 60.0) / m_Ratio) * (2.0 * M_PI * m_WheelSize);
+    m_MechSpeed = m_MechSpeed + (accel * duration);
+    m_Speed = m_MechSpeed;
+    m_TorqueSum = 0;
+    m_MechCount = 0;
+    m_Frequency = (m_Speed / (2.0 * M_PI * m_WheelSize)) * m_Ratio;
+}
+
 double MotorModel::getMotorPosition(void)
 {
     double rotorPos = m_Position - (m_syncdelay * 360.0 * m_Poles * m_Frequency);
@@ -22,28 +22,61 @@
 
 #include <QtMath>
 
+//Trig evaluation used by Step(), reference is the original per term qSin/qCos calculation
+enum TrigMode
+{
+    TRIG_REFERENCE = 0,
+    TRIG_FAST, //one sin/cos pair per distinct angle and cached constant terms
+    TRIG_PHASOR //as fast but the rotor angle is advanced by rotating a unit phasor
+};
+
+//Integration of the dq electrical equations over one step, speed and applied voltage held constant
+enum Integrator
+{
+    INTEG_EULER = 0, //original forward Euler
+    INTEG_SEMI_IMPLICIT, //resistive terms implicit, Iq updated with the new Id
+    INTEG_RK4,
+    INTEG_EXACT //exact zero order hold solution of the linear dq equations at the current speed
+};
+
 class MotorModel
 {
 public:
     MotorModel(double wheelSize,double ratio,double roadGradient,double mass,double Lq,double Ld,double Rs,double poles,double fluxLink,double timestep, double syncDelay, double sampPoint);
     void Step(double Va, double Vb, double Vc);
     void Restart(void);
+    void FastForward(double duration, double shaftAccel);
     void setWheelSize(double val) {m_WheelSize = val;}
     void setGboxRatio(double val) {m_Ratio = val;}
-    void setVehicleMass(double val) {m_Mass = val;}
+    void setVehicleMass(double val) {m_Mass = val; UpdateConstants();}
     void setLq(double val) {m_Lq = val;}
     void setLd(double val) {m_Ld = val;}
     void setRs(double val) {m_Rs = val;}
-    void setPoles(double val) {m_Poles = val;}
+    void setPoles(double val) {m_Poles = val; UpdateConstants();}
     void setFluxLinkage(double val) {m_FluxLink = val;}
     void setSyncDelay(double val) {m_syncdelay = val;}
     void setTimestep(double val) {m_Timestep = val;}
-    void setPosition(double val) {m_Position = (val * m_Poles);}
+    void setPosition(double val) {m_Position = (val * m_Poles); ResetPhasor();}
+    void setShaftSpeed(double rpm); //jump to a speed, the vehicle model carries on from there
+    void setDyno(bool val) {m_Dyno = val;} //shaft speed imposed by the dyno program, torque only measured
+    void setDynoSpeed(double rpm); //hold a constant speed, starting there straight away
+    void setDynoRamp(double rpm, double rate); //ramp from the current speed to rpm at rate rpm/s then hold
+    bool getDyno(void) {return m_Dyno;}
+    double getDynoTarget(void) {return m_DynoTarget;}
     void setSamplingPoint(double val) {m_samplingPoint = val;}
-    void setRoadGradient(double val) {m_RoadGradient = val;}
+    void setRoadGradient(double val) {m_RoadGradient = val; UpdateConstants();}
+    void setTrigMode(int val) {m_TrigMode = val; ResetPhasor();}
+    void setTrigCheck(bool val) {m_TrigCheck = val; m_TrigMaxError = 0;} //compare fast trig against the reference every step
+    void setMechDivider(int val) {m_MechDivider = qMax(val, 1);} //electrical steps per mechanical step
+    void setMechInterp(bool val) {m_MechInterp = val;} //extrapolate speed between mechanical steps rather than hold it
+    void setIntegrator(int val) {m_Integrator = val;}
+    int getIntegrator(void) {return m_Integrator;}
+    int getTrigMode(void) {return m_TrigMode;}
+    double getTrigMaxError(void) {return m_TrigMaxError;} //largest sin/cos error seen since check enabled
     double getMotorPosition(void);
     double getElecPosition(void);
     double getMotorFreq(void) {return m_Frequency;}
+    double getPoles(void) {return m_Poles;}
     bool getMotorDirection(void) {return (m_Speed>=0);}
     double getIa(void) {return m_Ia;} //gets current at end of period, ideal controller sampling point
     double getIb(void) {return m_Ib;}
@@ -67,6 +100,14 @@ public:
 
 
 private:
+    void UpdateConstants(void);
+    void ResetPhasor(void);
+    void PositionTrig(double position, double &cosPos, double &sinPos);
+    void CheckTrig(double position, double cosPos, double sinPos);
+    void StepMechanical(double torque, double h);
+    void StepDyno(double h);
+    void Integrate(double h, double Vd, double Vq, double we, double &Id, double &Iq);
+
     double m_WheelSize;
     double m_Ratio;
     double m_RoadGradient;
@@ -85,7 +126,11 @@ private:
     double m_Ia, m_Ib, m_Ic;
     double m_IaSamp, m_IbSamp, m_IcSamp;
     double m_Id, m_Iq;
-    double m_Speed; // m/s
+    double m_Speed; // m/s, as seen by the electrical model
+    double m_MechSpeed; // m/s at the last mechanical step
+    double m_Accel; // m/s^2 from the last mechanical step
+    double m_TorqueSum; //electrical torque accumulated since the last mechanical step
+    int m_MechCount;
     double m_Power;
     double m_Torque; //motor torque
 
@@ -98,6 +143,23 @@ private:
     double m_Vd_dueto_Rd;
     double m_VLd;
     double m_VLq;
+
+    bool m_Dyno;
+    double m_DynoStart; //rpm at the start of the program, Restart() goes back here
+    double m_DynoSpeed; //rpm
+    double m_DynoTarget; //rpm
+    double m_DynoRate; //rpm/s
+
+    int m_MechDivider;
+    bool m_MechInterp;
+    int m_Integrator;
+    int m_TrigMode;
+    bool m_TrigCheck;
+    double m_TrigMaxError;
+    double m_GradientForce; //cached, only changes with gradient or mass
+    double m_PolesRad; //poles * 2pi
+    double m_PhasorCos, m_PhasorSin; //unit phasor at m_Position, TRIG_PHASOR only
+    int m_PhasorSteps; //steps since last renormalisation
 };
 
 #endif // MOTORMODEL_H
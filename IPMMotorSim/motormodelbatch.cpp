@@ -0,0 +1,268 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "motormodelbatch.h"
+#include <QtMath>
+
+//no-trapping-math doesn't change any results, it lets the conditional position wrap become a vector select
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize ("tree-vectorize", "no-trapping-math")
+#endif
+
+//target_clones needs ifunc support, GCC on x86-64 linux only
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+#define BATCH_TARGET_CLONES __attribute__((target_clones("avx512f","avx2","default")))
+#else
+#define BATCH_TARGET_CLONES
+#endif
+
+#define INV_SQRT3 0.57735026918962576451
+#define SQRT3 1.73205080756887729353
+
+//raw pointers for the vectorised kernel, the columns never alias
+struct BatchColumns
+{
+    const double *__restrict Ratio, *__restrict WheelSize, *__restrict Rs, *__restrict Lq, *__restrict Ld, *__restrict Poles, *__restrict FluxLink, *__restrict samplingPoint;
+    const double *__restrict invLd, *__restrict invLq, *__restrict invMass, *__restrict GradientForce, *__restrict FreqScale;
+    double *__restrict Position, *__restrict Frequency, *__restrict Speed, *__restrict Id, *__restrict Iq;
+    double *__restrict Ia, *__restrict Ib, *__restrict Ic, *__restrict IaSamp, *__restrict IbSamp, *__restrict IcSamp;
+    double *__restrict Vd, *__restrict Vq, *__restrict Power, *__restrict Torque;
+};
+
+//round to nearest by adding and removing 1.5*2^52, plain arithmetic so it vectorises where nearbyint() is a library call
+static inline double roundNearest(double x)
+{
+    return (x + 6755399441055744.0) - 6755399441055744.0;
+}
+
+//sin and cos of an angle in degrees, quadrant reduction and Taylor series to x^14 on +-45deg, error below 1e-14
+//written without branches or library calls so that it vectorises
+static inline void batchSinCos(double degrees, double &s, double &c)
+{
+    double q = roundNearest(degrees * (1.0/90.0));
+    double x = (degrees - (q * 90.0)) * (M_PI/180.0);
+    double x2 = x * x;
+    double ps = x * (1.0 - x2*(1.0/6.0)*(1.0 - x2*(1.0/20.0)*(1.0 - x2*(1.0/42.0)*(1.0 - x2*(1.0/72.0)*(1.0 - x2*(1.0/110.0)*(1.0 - x2*(1.0/156.0)))))));
+    double pc = 1.0 - x2*(1.0/2.0)*(1.0 - x2*(1.0/12.0)*(1.0 - x2*(1.0/30.0)*(1.0 - x2*(1.0/56.0)*(1.0 - x2*(1.0/90.0)*(1.0 - x2*(1.0/132.0)*(1.0 - x2*(1.0/182.0)))))));
+    double quad = q - (4.0 * roundNearest((q * 0.25) - 0.375)); //0..3
+    double odd = quad - (2.0 * roundNearest((quad * 0.5) - 0.25)); //1 for quadrants 1 and 3
+    double sw_s = (odd != 0) ? pc : ps;
+    double sw_c = (odd != 0) ? ps : pc;
+    s = (quad >= 2.0) ? -sw_s : sw_s;
+    c = (((quad - 1.5) * (quad - 1.5)) < 1.0) ? -sw_c : sw_c; //negative in quadrants 1 and 2
+}
+
+BATCH_TARGET_CLONES
+static void stepFast(const BatchColumns &b, int count, double dt, const double *__restrict Va, const double *__restrict Vb)
+{
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC ivdep //each instance only touches its own element of every column
+#endif
+    for(int i = 0; i < count; i++)
+    {
+        double Valpha = Va[i];
+        double Vbeta = (Va[i] + (2.0 * Vb[i])) * INV_SQRT3;
+
+        double s, c;
+        batchSinCos(b.Position[i], s, c);
+        double Vd = (Valpha * c) + (Vbeta * s);
+        double Vq = (-Valpha * s) + (Vbeta * c);
+
+        double we = b.Poles[i] * b.Frequency[i] * (2 * M_PI);
+        double Id = b.Id[i], Iq = b.Iq[i];
+        double VLd = Vd - (b.Rs[i] * Id) + (we * b.Lq[i] * Iq);
+        double VLq = Vq - (b.Rs[i] * Iq) - (we * b.FluxLink[i]) - (we * b.Ld[i] * Id);
+
+        double sp = b.samplingPoint[i];
+        double IdSamp = Id + (VLd * dt * sp * b.invLd[i]);
+        double IqSamp = Iq + (VLq * dt * sp * b.invLq[i]);
+        Id = Id + (VLd * dt * b.invLd[i]);
+        Iq = Iq + (VLq * dt * b.invLq[i]);
+
+        double Ialpha = (Id * c) - (Iq * s);
+        double Ibeta = (Id * s) + (Iq * c);
+        b.Ia[i] = Ialpha;
+        b.Ib[i] = (-Ialpha + (SQRT3 * Ibeta)) * 0.5;
+        b.Ic[i] = (-Ialpha - (SQRT3 * Ibeta)) * 0.5;
+
+        double torque = 1.5 * b.Poles[i] * ((b.FluxLink[i] * Iq) + ((b.Ld[i] - b.Lq[i]) * Id * Iq));
+        double accel = (((torque * b.Ratio[i]) / b.WheelSize[i]) + b.GradientForce[i]) * b.invMass[i];
+        double speed = b.Speed[i] + (accel * dt);
+        double freq = speed * b.FreqScale[i];
+
+        double poleDeg = 360.0 * b.Poles[i];
+        double oldPosition = b.Position[i];
+        double position = oldPosition + (freq * dt * poleDeg);
+        double sampPosition = (oldPosition * (1.0 - sp)) + (position * sp);
+
+        batchSinCos(sampPosition, s, c);
+        Ialpha = (IdSamp * c) - (IqSamp * s);
+        Ibeta = (IdSamp * s) + (IqSamp * c);
+        b.IaSamp[i] = Ialpha;
+        b.IbSamp[i] = (-Ialpha + (SQRT3 * Ibeta)) * 0.5;
+        b.IcSamp[i] = (-Ialpha - (SQRT3 * Ibeta)) * 0.5;
+
+        position = (position > poleDeg) ? (position - poleDeg) : position;
+        position = (position < 0) ? (position + poleDeg) : position;
+
+        b.Vd[i] = Vd;
+        b.Vq[i] = Vq;
+        b.Id[i] = Id;
+        b.Iq[i] = Iq;
+        b.Torque[i] = torque;
+        b.Speed[i] = speed;
+        b.Frequency[i] = freq;
+        b.Power[i] = (2.0 * M_PI) * freq * torque;
+        b.Position[i] = position;
+    }
+}
+
+MotorModelBatch::MotorModelBatch(int count, double timestep)
+    :m_count{count}, m_Timestep{timestep}, m_referenceMode{false}
+{
+    QVector<double> *columns[] = {&m_WheelSize, &m_Ratio, &m_RoadGradient, &m_Mass, &m_Lq, &m_Ld, &m_Rs, &m_Poles, &m_FluxLink, &m_syncdelay, &m_samplingPoint,
+                                  &m_invLd, &m_invLq, &m_invMass, &m_GradientForce, &m_FreqScale,
+                                  &m_Position, &m_Frequency, &m_Speed, &m_Id, &m_Iq, &m_Ia, &m_Ib, &m_Ic, &m_IaSamp, &m_IbSamp, &m_IcSamp,
+                                  &m_Vd, &m_Vq, &m_Power, &m_Torque};
+    for(QVector<double> *col : columns)
+        col->fill(0, count);
+}
+
+void MotorModelBatch::setInstance(int i, double wheelSize,double ratio,double roadGradient,double mass,double Lq,double Ld,double Rs,double poles,double fluxLink, double syncDelay, double sampPoint)
+{
+    m_WheelSize[i] = wheelSize;
+    m_Ratio[i] = ratio;
+    m_RoadGradient[i] = roadGradient;
+    m_Mass[i] = mass;
+    m_Lq[i] = Lq;
+    m_Ld[i] = Ld;
+    m_Rs[i] = Rs;
+    m_Poles[i] = poles;
+    m_FluxLink[i] = fluxLink;
+    m_syncdelay[i] = syncDelay;
+    m_samplingPoint[i] = sampPoint;
+
+    m_invLd[i] = 1.0/Ld;
+    m_invLq[i] = 1.0/Lq;
+    m_invMass[i] = 1.0/mass;
+    m_GradientForce[i] = -(roadGradient/qSqrt(1.0 + (roadGradient*roadGradient)))*mass*9.81;
+    m_FreqScale[i] = ratio / (2.0 * M_PI * wheelSize);
+}
+
+void MotorModelBatch::Restart(void)
+{
+    QVector<double> *state[] = {&m_Position, &m_Frequency, &m_Speed, &m_Id, &m_Iq, &m_Ia, &m_Ib, &m_Ic, &m_IaSamp, &m_IbSamp, &m_IcSamp,
+                                &m_Vd, &m_Vq, &m_Power, &m_Torque};
+    for(QVector<double> *col : state)
+        col->fill(0);
+}
+
+void MotorModelBatch::Step(const double *Va, const double *Vb, const double *Vc)
+{
+    (void)Vc;
+    if(m_referenceMode)
+    {
+        StepReference(Va, Vb);
+        return;
+    }
+
+    BatchColumns b = {m_Ratio.constData(), m_WheelSize.constData(), m_Rs.constData(), m_Lq.constData(), m_Ld.constData(), m_Poles.constData(), m_FluxLink.constData(), m_samplingPoint.constData(),
+                      m_invLd.constData(), m_invLq.constData(), m_invMass.constData(), m_GradientForce.constData(), m_FreqScale.constData(),
+                      m_Position.data(), m_Frequency.data(), m_Speed.data(), m_Id.data(), m_Iq.data(),
+                      m_Ia.data(), m_Ib.data(), m_Ic.data(), m_IaSamp.data(), m_IbSamp.data(), m_IcSamp.data(),
+                      m_Vd.data(), m_Vq.data(), m_Power.data(), m_Torque.data()};
+    stepFast(b, m_count, m_Timestep, Va, Vb);
+}
+
+//same expressions in the same order as MotorModel::Step() so the results match bit for bit
+void MotorModelBatch::StepReference(const double *Va, const double *Vb)
+{
+    for(int i = 0; i < m_count; i++)
+    {
+        double Valpha = Va[i];
+        double Vbeta = ((Va[i]+(2.0*Vb[i]))/qSqrt(3.0));
+
+        double elecAngle = fmod(m_Position[i],360.0);
+        double cosPos = qCos(qDegreesToRadians(m_Position[i]));
+        double sinPos = qSin(qDegreesToRadians(m_Position[i]));
+        double cosElec = qCos(qDegreesToRadians(elecAngle));
+        double sinElec = qSin(qDegreesToRadians(elecAngle));
+
+        m_Vd[i] = (Valpha * cosPos) + (Vbeta * sinElec);
+        m_Vq[i] = (-Valpha * sinPos) + (Vbeta * cosElec);
+
+        double Vq_bemf = m_FluxLink[i] * m_Poles[i] * m_Frequency[i] * 2 * M_PI;
+        double Vq_dueto_id = m_Poles[i] * m_Frequency[i] * 2 * M_PI * m_Ld[i] * m_Id[i];
+        double Vd_dueto_iq = m_Poles[i] * m_Frequency[i] * 2 * M_PI * m_Lq[i] * m_Iq[i];
+        double Vd_dueto_Rd = (m_Rs[i] * m_Id[i]);
+        double Vq_dueto_Rq = (m_Rs[i] * m_Iq[i]);
+
+        double VLd = m_Vd[i] - Vd_dueto_Rd + Vd_dueto_iq;
+        double VLq = m_Vq[i] - Vq_dueto_Rq - Vq_bemf - Vq_dueto_id;
+
+        double IdSamp = m_Id[i] + (VLd * m_Timestep * m_samplingPoint[i])/m_Ld[i];
+        double IqSamp = m_Iq[i] + (VLq * m_Timestep * m_samplingPoint[i])/m_Lq[i];
+        double oldPosition = m_Position[i];
+
+        m_Id[i] = m_Id[i] + (VLd * m_Timestep)/m_Ld[i];
+        m_Iq[i] = m_Iq[i] + (VLq * m_Timestep)/m_Lq[i];
+
+        double Ialpha = (m_Id[i] * cosElec) - (m_Iq[i] * sinElec);
+        double Ibeta = (m_Id[i] * sinElec) + (m_Iq[i] * cosElec);
+        m_Ia[i] = Ialpha;
+        m_Ib[i] = (-Ialpha + (qSqrt(3.0) * Ibeta)) / 2.0;
+        m_Ic[i] = (-Ialpha - (qSqrt(3.0) * Ibeta)) / 2.0;
+
+        m_Torque[i] = (3.0/2.0) * m_Poles[i] * ((m_FluxLink[i] * m_Iq[i]) + ((m_Ld[i] - m_Lq[i]) * m_Id[i] * m_Iq[i]));
+
+        double wheelTorque = (m_Torque[i] * m_Ratio[i]) / m_WheelSize[i];
+        double gradientForce = -(qSin(qAtan(m_RoadGradient[i]))*m_Mass[i]*9.81);
+        double accel = (wheelTorque + gradientForce)/m_Mass[i];
+        m_Speed[i] = m_Speed[i] + (accel * m_Timestep);
+        m_Frequency[i] = (m_Speed[i] / (2.0 * M_PI * m_WheelSize[i])) * m_Ratio[i];
+        m_Power[i] = 2.0 * M_PI * m_Frequency[i] * m_Torque[i];
+
+        double posDelta = m_Frequency[i] * m_Timestep * (360.0 * m_Poles[i]);
+        m_Position[i] = m_Position[i] + posDelta;
+
+        double sampPosition = ((oldPosition * (1.0-m_samplingPoint[i])) + (m_Position[i] * m_samplingPoint[i]));
+        double elecAngleSamp = fmod(sampPosition, 360.0);
+        Ialpha = (IdSamp * qCos(qDegreesToRadians(elecAngleSamp))) - (IqSamp * qSin(qDegreesToRadians(elecAngleSamp)));
+        Ibeta = (IdSamp * qSin(qDegreesToRadians(elecAngleSamp))) + (IqSamp * qCos(qDegreesToRadians(elecAngleSamp)));
+        m_IaSamp[i] = Ialpha;
+        m_IbSamp[i] = (-Ialpha + (qSqrt(3.0) * Ibeta)) / 2.0;
+        m_IcSamp[i] = (-Ialpha - (qSqrt(3.0) * Ibeta)) / 2.0;
+
+        if(m_Position[i]>(360.0 * m_Poles[i]))
+            m_Position[i] = m_Position[i] - (360.0 * m_Poles[i]);
+        if(m_Position[i]<0)
+            m_Position[i] = m_Position[i] + (360.0 * m_Poles[i]);
+    }
+}
+
+double MotorModelBatch::getElecPosition(int i)
+{
+    double rotorPos = m_Position[i] - (m_syncdelay[i] * 360.0 * m_Poles[i] * m_Frequency[i]);
+    if(rotorPos>(360.0 * m_Poles[i]))
+        rotorPos = rotorPos - (360.0 * m_Poles[i]);
+    if(rotorPos<0)
+        rotorPos = rotorPos + (360.0 * m_Poles[i]);
+
+    return (fmod(rotorPos,360.0));
+}
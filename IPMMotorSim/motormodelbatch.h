@@ -0,0 +1,71 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MOTORMODELBATCH_H
+#define MOTORMODELBATCH_H
+
+#include <QVector>
+
+//N independent motors advanced in lock-step, state and parameters stored as struct of arrays
+//Reference mode reproduces MotorModel (Euler, TRIG_REFERENCE, single rate) bit for bit, one instance at a time
+//Fast mode uses a branch free sin/cos so the whole batch vectorises, built for AVX-512/AVX2 with a scalar fallback
+class MotorModelBatch
+{
+public:
+    MotorModelBatch(int count, double timestep);
+    void setInstance(int i, double wheelSize,double ratio,double roadGradient,double mass,double Lq,double Ld,double Rs,double poles,double fluxLink, double syncDelay, double sampPoint);
+    void setReferenceMode(bool val) {m_referenceMode = val;}
+    void setTimestep(double val) {m_Timestep = val;}
+    void Restart(void);
+    void Step(const double *Va, const double *Vb, const double *Vc); //one voltage per instance
+    int getCount(void) {return m_count;}
+    double getElecPosition(int i);
+    double getMotorFreq(int i) {return m_Frequency[i];}
+    double getIaSamp(int i) {return m_IaSamp[i];}
+    double getIbSamp(int i) {return m_IbSamp[i];}
+    double getIcSamp(int i) {return m_IcSamp[i];}
+    double getIa(int i) {return m_Ia[i];}
+    double getIb(int i) {return m_Ib[i];}
+    double getIc(int i) {return m_Ic[i];}
+    double getId(int i) {return m_Id[i];}
+    double getIq(int i) {return m_Iq[i];}
+    double getVd(int i) {return m_Vd[i];}
+    double getVq(int i) {return m_Vq[i];}
+    double getTorque(int i) {return m_Torque[i];}
+    double getPower(int i) {return m_Power[i];}
+
+private:
+    void StepReference(const double *Va, const double *Vb);
+
+    int m_count;
+    double m_Timestep;
+    bool m_referenceMode;
+
+    //parameters
+    QVector<double> m_WheelSize, m_Ratio, m_RoadGradient, m_Mass, m_Lq, m_Ld, m_Rs, m_Poles, m_FluxLink, m_syncdelay, m_samplingPoint;
+    //cached per instance terms for the fast path
+    QVector<double> m_invLd, m_invLq, m_invMass, m_GradientForce, m_FreqScale;
+
+    //state
+    QVector<double> m_Position, m_Frequency, m_Speed, m_Id, m_Iq;
+    QVector<double> m_Ia, m_Ib, m_Ic, m_IaSamp, m_IbSamp, m_IcSamp;
+    QVector<double> m_Vd, m_Vq, m_Power, m_Torque;
+};
+
+#endif // MOTORMODELBATCH_H
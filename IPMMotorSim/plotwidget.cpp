@@ -0,0 +1,505 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "plotwidget.h"
+#include <QPainter>
+#include <QPolygonF>
+#include <QRubberBand>
+#include <QMouseEvent>
+#include <QWheelEvent>
+#include <QKeyEvent>
+#include <QtMath>
+#include <limits.h>
+
+#define PLOT_MARGIN_AXIS 70 //room for the tick labels and title of a y axis
+#define PLOT_MARGIN_EDGE 20
+#define PLOT_MARGIN_TOP 24 //legend
+#define PLOT_MARGIN_BOTTOM 45
+#define PLOT_Y_LIMIT 1e6 //pixel coordinates are clamped to this to keep the painter happy
+
+//same order as the QtCharts light theme so switching backend doesn't change the colours
+static const QColor defaultColours[] =
+{
+    QColor(0x20, 0x9f, 0xdf), QColor(0x99, 0xca, 0x53), QColor(0xf6, 0xa6, 0x25),
+    QColor(0x6d, 0x5f, 0xd5), QColor(0xbf, 0x59, 0x3e)
+};
+
+//Merges consecutive points landing in the same pixel column into the entry, min, max and exit points
+//so a trace never draws more than four points a column however long it is
+class ColumnBinner
+{
+public:
+    ColumnBinner(QPolygonF &line, double minX, double maxX)
+        :m_line(line), m_minX(minX), m_maxX(maxX), m_column(INT_MIN) {}
+
+    void add(double x, double y)
+    {
+        if(qIsNaN(x) || qIsNaN(y))
+            return;
+
+        x = qBound(m_minX, x, m_maxX); //points off either side share a column just outside the plot
+        y = qBound(-PLOT_Y_LIMIT, y, PLOT_Y_LIMIT);
+        int column = qFloor(x);
+        if(column != m_column)
+        {
+            flush();
+            m_column = column;
+            m_first = m_min = m_max = m_last = y;
+        }
+        else
+        {
+            if(y < m_min) m_min = y;
+            if(y > m_max) m_max = y;
+            m_last = y;
+        }
+    }
+
+    void flush(void)
+    {
+        if(m_column == INT_MIN)
+            return;
+
+        double x = m_column + 0.5;
+        m_line << QPointF(x, m_first);
+        if(m_max > m_min)
+            m_line << QPointF(x, m_min) << QPointF(x, m_max);
+        m_line << QPointF(x, m_last);
+        m_column = INT_MIN;
+    }
+
+private:
+    QPolygonF &m_line;
+    double m_minX, m_maxX;
+    int m_column;
+    double m_first, m_min, m_max, m_last;
+};
+
+//1, 2 or 5 times a power of ten giving no more than the given number of ticks
+static double tickStep(double span, int maxTicks)
+{
+    double raw = span / qMax(maxTicks, 1);
+    double magnitude = qPow(10, qFloor(log10(raw)));
+    double norm = raw / magnitude;
+    if(norm <= 1) return magnitude;
+    if(norm <= 2) return 2 * magnitude;
+    if(norm <= 5) return 5 * magnitude;
+    return 10 * magnitude;
+}
+
+static QString tickLabel(double value, double step)
+{
+    if(qAbs(value) < step * 1e-9)
+        value = 0; //avoid labels like 1e-17
+    return QString::number(value, 'g', 6);
+}
+
+PlotWidget::PlotWidget(QWidget *parent) : QWidget(parent)
+{
+    setAxis(m_x, 0, 1);
+    setAxis(m_left, 0, 1);
+    setAxis(m_right, 0, 1);
+    m_axisValid = false;
+    m_traceValid = false;
+    m_panning = false;
+    m_rubberBand = new QRubberBand(QRubberBand::Rectangle, this);
+    setFocusPolicy(Qt::StrongFocus);
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    layoutPlot();
+}
+
+void PlotWidget::setTraces(const QVector<PlotTrace> &traces)
+{
+    m_traces = traces;
+    layoutPlot(); //right axis may have come or gone
+    invalidate();
+}
+
+void PlotWidget::setAxisText(QString x, QString left, QString right)
+{
+    m_x.title = x;
+    m_left.title = left;
+    m_right.title = right;
+    layoutPlot();
+    invalidate();
+}
+
+void PlotWidget::setRanges(double minX, double maxX, double minL, double maxL, double minR, double maxR)
+{
+    setAxis(m_x, minX, maxX);
+    setAxis(m_left, minL, maxL);
+    setAxis(m_right, minR, maxR);
+    invalidate();
+}
+
+void PlotWidget::setXRange(double min, double max)
+{
+    setAxis(m_x, min, max);
+    invalidate();
+}
+
+void PlotWidget::setLeftRange(double min, double max)
+{
+    setAxis(m_left, min, max);
+    invalidate();
+}
+
+//ranges left at their empty values (max below min) or collapsed to a point still need something to draw against
+void PlotWidget::setAxis(PlotAxis &axis, double min, double max)
+{
+    if(!qIsFinite(min) || !qIsFinite(max) || min > max)
+    {
+        min = 0;
+        max = 1;
+    }
+    else if(min == max)
+    {
+        min -= 1;
+        max += 1;
+    }
+    axis.min = axis.homeMin = min;
+    axis.max = axis.homeMax = max;
+}
+
+void PlotWidget::layoutPlot(void)
+{
+    bool rightUsed = !m_right.title.isEmpty();
+    for(int i = 0; i < m_traces.size(); i++)
+        rightUsed |= m_traces[i].rightAxis;
+
+    int right = rightUsed ? PLOT_MARGIN_AXIS : PLOT_MARGIN_EDGE;
+    m_plotArea = QRect(PLOT_MARGIN_AXIS, PLOT_MARGIN_TOP,
+                       qMax(10, width() - PLOT_MARGIN_AXIS - right),
+                       qMax(10, height() - PLOT_MARGIN_TOP - PLOT_MARGIN_BOTTOM));
+}
+
+void PlotWidget::invalidate(void)
+{
+    m_axisValid = false;
+    m_traceValid = false;
+    update();
+}
+
+void PlotWidget::drawAxes(void)
+{
+    m_axisLayer = QPixmap(size());
+    m_axisLayer.fill(Qt::white);
+    QPainter painter(&m_axisLayer);
+    QFontMetrics metrics = painter.fontMetrics();
+    QPen gridPen(QColor(220, 220, 220));
+    QPen axisPen(Qt::darkGray);
+    int textHeight = metrics.height();
+
+    //x grid and labels
+    double sx = m_plotArea.width() / (m_x.max - m_x.min);
+    double step = tickStep(m_x.max - m_x.min, m_plotArea.width() / 100);
+    for(double v = qCeil(m_x.min / step) * step; v <= m_x.max; v += step)
+    {
+        int px = m_plotArea.left() + qRound((v - m_x.min) * sx);
+        painter.setPen(gridPen);
+        painter.drawLine(px, m_plotArea.top(), px, m_plotArea.bottom());
+        painter.setPen(Qt::black);
+        painter.drawText(QRect(px - 50, m_plotArea.bottom() + 4, 100, textHeight), Qt::AlignHCenter | Qt::AlignTop, tickLabel(v, step));
+    }
+
+    //left y grid and labels
+    double sy = m_plotArea.height() / (m_left.max - m_left.min);
+    step = tickStep(m_left.max - m_left.min, m_plotArea.height() / 50);
+    for(double v = qCeil(m_left.min / step) * step; v <= m_left.max; v += step)
+    {
+        int py = m_plotArea.bottom() - qRound((v - m_left.min) * sy);
+        painter.setPen(gridPen);
+        painter.drawLine(m_plotArea.left(), py, m_plotArea.right(), py);
+        painter.setPen(Qt::black);
+        painter.drawText(QRect(0, py - textHeight / 2, m_plotArea.left() - 4, textHeight), Qt::AlignRight | Qt::AlignVCenter, tickLabel(v, step));
+    }
+
+    //right y ticks and labels, no grid so it doesn't fight the left one
+    int rightMargin = width() - m_plotArea.right();
+    if(rightMargin > PLOT_MARGIN_EDGE)
+    {
+        sy = m_plotArea.height() / (m_right.max - m_right.min);
+        step = tickStep(m_right.max - m_right.min, m_plotArea.height() / 50);
+        for(double v = qCeil(m_right.min / step) * step; v <= m_right.max; v += step)
+        {
+            int py = m_plotArea.bottom() - qRound((v - m_right.min) * sy);
+            painter.setPen(axisPen);
+            painter.drawLine(m_plotArea.right(), py, m_plotArea.right() + 4, py);
+            painter.setPen(Qt::black);
+            painter.drawText(QRect(m_plotArea.right() + 6, py - textHeight / 2, rightMargin - 6, textHeight), Qt::AlignLeft | Qt::AlignVCenter, tickLabel(v, step));
+        }
+    }
+
+    painter.setPen(axisPen);
+    painter.drawRect(m_plotArea);
+
+    //titles
+    painter.setPen(Qt::black);
+    painter.drawText(QRect(m_plotArea.left(), height() - textHeight - 2, m_plotArea.width(), textHeight), Qt::AlignCenter, m_x.title);
+    painter.save();
+    painter.translate(textHeight / 2 + 2, m_plotArea.center().y());
+    painter.rotate(-90);
+    painter.drawText(QRect(-m_plotArea.height() / 2, -textHeight / 2, m_plotArea.height(), textHeight), Qt::AlignCenter, m_left.title);
+    painter.restore();
+    painter.save();
+    painter.translate(width() - textHeight / 2 - 2, m_plotArea.center().y());
+    painter.rotate(90);
+    painter.drawText(QRect(-m_plotArea.height() / 2, -textHeight / 2, m_plotArea.height(), textHeight), Qt::AlignCenter, m_right.title);
+    painter.restore();
+
+    //legend along the top
+    int x = m_plotArea.left();
+    int y = (PLOT_MARGIN_TOP - textHeight) / 2;
+    for(int i = 0; i < m_traces.size(); i++)
+    {
+        const PlotTrace &trace = m_traces[i];
+        painter.setPen(QPen(trace.colour.isValid() ? trace.colour : defaultColours[i % 5], 2));
+        painter.drawLine(x, y + textHeight / 2, x + 16, y + textHeight / 2);
+        painter.setPen(Qt::black);
+        painter.drawText(x + 20, y + metrics.ascent(), trace.name);
+        x += 20 + metrics.horizontalAdvance(trace.name) + 12;
+    }
+
+    m_axisValid = true;
+}
+
+void PlotWidget::drawTraces(void)
+{
+    m_traceLayer = QPixmap(size());
+    m_traceLayer.fill(Qt::transparent);
+    QPainter painter(&m_traceLayer);
+    painter.setClipRect(m_plotArea);
+
+    for(int i = 0; i < m_traces.size(); i++)
+        drawTrace(painter, m_traces[i], m_traces[i].colour.isValid() ? m_traces[i].colour : defaultColours[i % 5]);
+
+    m_traceValid = true;
+}
+
+void PlotWidget::drawTrace(QPainter &painter, const PlotTrace &trace, QColor colour)
+{
+    const PlotAxis &yAxis = trace.rightAxis ? m_right : m_left;
+    double sx = m_plotArea.width() / (m_x.max - m_x.min);
+    double sy = m_plotArea.height() / (yAxis.max - yAxis.min);
+    double left = m_plotArea.left();
+    double bottom = m_plotArea.bottom();
+
+    QPolygonF line;
+    ColumnBinner binner(line, m_plotArea.left() - 1, m_plotArea.right() + 1);
+    if(trace.points)
+    {
+        const QList<QPointF> &points = *trace.points;
+        for(int i = 0; i < points.size(); i++)
+            binner.add(left + (points[i].x() - m_x.min) * sx, bottom - (points[i].y() - yAxis.min) * sy);
+    }
+    else if(trace.recorder)
+    {
+        int first = trace.first;
+        int last = qMin(trace.last, trace.recorder->count()); //recorder may have been truncated since
+        if(trace.xChannel == TR_TIME)
+            trace.recorder->timeRows(m_x.min, m_x.max, first, last);
+
+        const TraceRecorder *recorder = trace.recorder;
+        const TraceValue *y = recorder->column(trace.yChannel);
+        if(trace.pyramid && trace.xChannel == TR_TIME && (last - first) > 4 * m_plotArea.width()) //y extremes alone would reshape an x/y trace
+        {
+            trace.pyramid->Query(y, first, last, m_plotArea.width(), m_rows);
+            for(int i = 0; i < m_rows.size(); i++)
+                binner.add(left + (recorder->value(trace.xChannel, m_rows[i]) - m_x.min) * sx, bottom - (y[m_rows[i]] - yAxis.min) * sy);
+        }
+        else
+        {
+            last = qMin(last, recorder->rows(trace.yChannel)); //later rows of a channel that is switched off are NaN
+            for(int i = first; i < last; i++)
+                binner.add(left + (recorder->value(trace.xChannel, i) - m_x.min) * sx, bottom - (y[i] - yAxis.min) * sy);
+        }
+    }
+    binner.flush();
+
+    painter.setPen(QPen(colour, 1));
+    painter.setOpacity(trace.opacity);
+    painter.drawPolyline(line);
+}
+
+void PlotWidget::paintEvent(QPaintEvent *)
+{
+    if(!m_axisValid)
+        drawAxes();
+    if(!m_traceValid)
+        drawTraces();
+
+    QPainter painter(this);
+    painter.drawPixmap(0, 0, m_axisLayer);
+    painter.drawPixmap(0, 0, m_traceLayer);
+}
+
+void PlotWidget::resizeEvent(QResizeEvent *)
+{
+    layoutPlot();
+    invalidate();
+}
+
+//factor below one zooms in, about centreX on the time axis
+void PlotWidget::zoom(double factor, double centreX, bool zoomY)
+{
+    m_x.min = centreX - (centreX - m_x.min) * factor;
+    m_x.max = centreX + (m_x.max - centreX) * factor;
+    if(zoomY)
+    {
+        double centre = (m_left.min + m_left.max) / 2;
+        m_left.min = centre - (centre - m_left.min) * factor;
+        m_left.max = centre + (m_left.max - centre) * factor;
+        centre = (m_right.min + m_right.max) / 2;
+        m_right.min = centre - (centre - m_right.min) * factor;
+        m_right.max = centre + (m_right.max - centre) * factor;
+    }
+    invalidate();
+}
+
+void PlotWidget::zoomTo(QRect area)
+{
+    area &= m_plotArea;
+    if(area.width() < 4 || area.height() < 4)
+        return;
+
+    double sx = (m_x.max - m_x.min) / m_plotArea.width();
+    double x0 = m_x.min;
+    m_x.min = x0 + (area.left() - m_plotArea.left()) * sx;
+    m_x.max = x0 + (area.right() - m_plotArea.left()) * sx;
+
+    PlotAxis *axes[] = {&m_left, &m_right};
+    for(int i = 0; i < 2; i++)
+    {
+        double sy = (axes[i]->max - axes[i]->min) / m_plotArea.height();
+        double y0 = axes[i]->min;
+        axes[i]->min = y0 + (m_plotArea.bottom() - area.bottom()) * sy;
+        axes[i]->max = y0 + (m_plotArea.bottom() - area.top()) * sy;
+    }
+    invalidate();
+}
+
+//move the view by a number of pixels, positive is right and up
+void PlotWidget::scroll(double dx, double dy)
+{
+    double sx = (m_x.max - m_x.min) / m_plotArea.width();
+    m_x.min += dx * sx;
+    m_x.max += dx * sx;
+
+    PlotAxis *axes[] = {&m_left, &m_right};
+    for(int i = 0; i < 2; i++)
+    {
+        double sy = (axes[i]->max - axes[i]->min) / m_plotArea.height();
+        axes[i]->min += dy * sy;
+        axes[i]->max += dy * sy;
+    }
+    invalidate();
+}
+
+void PlotWidget::home(void)
+{
+    PlotAxis *axes[] = {&m_x, &m_left, &m_right};
+    for(int i = 0; i < 3; i++)
+    {
+        axes[i]->min = axes[i]->homeMin;
+        axes[i]->max = axes[i]->homeMax;
+    }
+    invalidate();
+}
+
+void PlotWidget::mousePressEvent(QMouseEvent *event)
+{
+    m_dragStart = event->pos();
+    if(event->button() == Qt::LeftButton)
+    {
+        m_rubberBand->setGeometry(QRect(m_dragStart, QSize()));
+        m_rubberBand->show();
+    }
+    else if(event->button() == Qt::MiddleButton)
+        m_panning = true;
+}
+
+void PlotWidget::mouseMoveEvent(QMouseEvent *event)
+{
+    if(m_panning)
+    {
+        QPoint delta = event->pos() - m_dragStart;
+        scroll(-delta.x(), delta.y());
+        m_dragStart = event->pos();
+    }
+    else if(m_rubberBand->isVisible())
+        m_rubberBand->setGeometry(QRect(m_dragStart, event->pos()).normalized());
+}
+
+void PlotWidget::mouseReleaseEvent(QMouseEvent *event)
+{
+    if(event->button() == Qt::LeftButton && m_rubberBand->isVisible())
+    {
+        m_rubberBand->hide();
+        zoomTo(m_rubberBand->geometry());
+    }
+    else if(event->button() == Qt::RightButton)
+        zoom(2.0, (m_x.min + m_x.max) / 2, true);
+    else if(event->button() == Qt::MiddleButton)
+        m_panning = false;
+}
+
+void PlotWidget::mouseDoubleClickEvent(QMouseEvent *)
+{
+    home();
+}
+
+void PlotWidget::wheelEvent(QWheelEvent *event)
+{
+    if(event->angleDelta().y() == 0)
+        return;
+
+    double x = m_x.min + (event->position().x() - m_plotArea.left()) * (m_x.max - m_x.min) / m_plotArea.width();
+    zoom(event->angleDelta().y() > 0 ? 0.8 : 1.25, x, false);
+}
+
+//same keys as ChartView
+void PlotWidget::keyPressEvent(QKeyEvent *event)
+{
+    switch (event->key()) {
+    case Qt::Key_Plus:
+        zoom(0.5, (m_x.min + m_x.max) / 2, true);
+        break;
+    case Qt::Key_Minus:
+        zoom(2.0, (m_x.min + m_x.max) / 2, true);
+        break;
+    case Qt::Key_Left:
+        scroll(-10, 0);
+        break;
+    case Qt::Key_Right:
+        scroll(10, 0);
+        break;
+    case Qt::Key_Up:
+        scroll(0, 10);
+        break;
+    case Qt::Key_Down:
+        scroll(0, -10);
+        break;
+    case Qt::Key_Home:
+        home();
+        break;
+    default:
+        QWidget::keyPressEvent(event);
+        break;
+    }
+}
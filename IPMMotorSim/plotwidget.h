@@ -0,0 +1,106 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef PLOTWIDGET_H
+#define PLOTWIDGET_H
+
+#include <QWidget>
+#include <QPixmap>
+#include <QVector>
+#include <QList>
+#include <QPointF>
+#include <QColor>
+#include "tracerecorder.h"
+#include "minmaxpyramid.h"
+
+class QRubberBand;
+
+//one line on a PlotWidget, either a list of points or rows of recorder columns
+struct PlotTrace
+{
+    QString name;
+    QColor colour; //invalid for the default colour
+    qreal opacity;
+    bool rightAxis;
+    const QList<QPointF> *points; //nullptr for a recorder trace
+    const TraceRecorder *recorder;
+    int xChannel;
+    int yChannel;
+    int first, last; //rows shown
+    const MinMaxPyramid *pyramid;
+};
+
+struct PlotAxis
+{
+    double min, max;
+    double homeMin, homeMax; //range set by the owner, restored by Home or a double click
+    QString title;
+};
+
+//Lightweight alternative to QtCharts for long traces
+//Traces are drawn straight from their data binned to pixel columns, axes, grid and legend are cached until the layout or ranges change
+//Left drag zooms to a rectangle, right click zooms out, middle drag pans, the wheel zooms time about the cursor
+class PlotWidget : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit PlotWidget(QWidget *parent = nullptr);
+    void setTraces(const QVector<PlotTrace> &traces);
+    void setAxisText(QString x, QString left, QString right);
+    void setRanges(double minX, double maxX, double minL, double maxL, double minR, double maxR);
+    void setXRange(double min, double max);
+    void setLeftRange(double min, double max);
+
+protected:
+    void paintEvent(QPaintEvent *event);
+    void resizeEvent(QResizeEvent *event);
+    void mousePressEvent(QMouseEvent *event);
+    void mouseMoveEvent(QMouseEvent *event);
+    void mouseReleaseEvent(QMouseEvent *event);
+    void mouseDoubleClickEvent(QMouseEvent *event);
+    void wheelEvent(QWheelEvent *event);
+    void keyPressEvent(QKeyEvent *event);
+
+private:
+    QVector<PlotTrace> m_traces;
+    PlotAxis m_x, m_left, m_right;
+    QRect m_plotArea;
+    QPixmap m_axisLayer;
+    QPixmap m_traceLayer;
+    bool m_axisValid;
+    bool m_traceValid;
+    QRubberBand *m_rubberBand;
+    QPoint m_dragStart;
+    bool m_panning;
+    QVector<int> m_rows; //pyramid query buffer, kept between paints
+
+    void setAxis(PlotAxis &axis, double min, double max);
+    void layoutPlot(void);
+    void invalidate(void);
+    void drawAxes(void);
+    void drawTraces(void);
+    void drawTrace(QPainter &painter, const PlotTrace &trace, QColor colour);
+    void zoom(double factor, double centreX, bool zoomY);
+    void zoomTo(QRect area);
+    void scroll(double dx, double dy);
+    void home(void);
+};
+
+#endif // PLOTWIDGET_H
@@ -0,0 +1,395 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "scenario.h"
+#include <QSettings>
+#include <QFileInfo>
+#include <QStringList>
+#include <QDataStream>
+#include <QtMath>
+#include "params.h"
+#include "warmstartcache.h"
+#include "binlogwriter.h"
+
+//simulator fields, defaults match the GUI
+static const struct { const char *name; double def; } simFields[] =
+{
+    {"vehicleWeight", 500},
+    {"wheelSize", 0.3},
+    {"gearRatio", 6},
+    {"RoadGradient", 0},    //%
+    {"Vdc", 350},
+    {"Lq", 0.5},            //mH
+    {"Ld", 0.16},           //mH
+    {"Rs", 0.075},
+    {"SyncDelay", 16},      //uS
+    {"LoopFreq", 8800},
+    {"SamplingPoint", 50},  //%
+    {"ExtraCycleDelay", 1},
+    {"AddNoise", 0},
+    {"NoiseAmp", 10},
+    {"ThrotRamps", 0},
+    {"runTime", 5},
+    {"torqueDemand", 100},
+    {"opMode", 1},
+    {"direction", 1},
+    {"Integrator", 0},      //0=Euler, 1=semi-implicit Euler, 2=RK4, 3=exact zero order hold
+    {"MechDivider", 1},     //electrical steps per mechanical/vehicle step
+    {"MechInterp", 0},      //1=extrapolate speed between mechanical steps, 0=hold
+    {"ConvVd", 0},          //open loop dq voltages for the convergence report
+    {"ConvVq", 20},
+    {"TrigMode", 0},        //0=reference, 1=fast, 2=phasor rotation
+    {"TrigCheck", 0},       //report worst fast trig error against the reference
+    {"DynoMode", 0},        //1=shaft speed held by the dyno rather than the vehicle model
+    {"DynoSpeed", 0},       //rpm
+    {"DynoRamp", 0},        //rpm/s towards a segment's speed, 0=jump straight to it
+};
+
+//OpenInverter parameters, only applied if present in the file
+static const struct { const char *name; Param::PARAM_NUM param; } firmwareFields[] =
+{
+    {"throttleCurrent", Param::throtcur},
+    {"IqManual", Param::manualiq},
+    {"IdManual", Param::manualid},
+    {"Poles", Param::polepairs},
+    {"CurrentKp", Param::curkp},
+    {"CurrentKi", Param::curki},
+    {"VLimMargin", Param::vlimmargin},
+    {"VLimFlt", Param::vlimflt},
+    {"LqMinusLd", Param::lqminusld},
+    {"SyncAdv", Param::syncadv},
+    {"SyncOfs", Param::syncofs},
+    {"FWCurrMax", Param::fwcurmax},
+    {"FreqMax", Param::fmax},
+    {"FluxLinkage", Param::fluxlinkage},
+};
+
+Scenario::Scenario()
+    :m_opMode{1}, m_direction{1}, m_steady{false}, m_fastForward{false}, m_flightSeconds{1}, m_binLogRotate{0}
+{
+    for(auto &f : simFields)
+        m_values[f.name] = f.def;
+}
+
+bool Scenario::Load(const QString &fileName)
+{
+    if(!QFileInfo::exists(fileName))
+    {
+        m_error = "Scenario file not found: " + fileName;
+        return false;
+    }
+
+    QSettings settings(fileName, QSettings::IniFormat);
+    m_fileName = fileName;
+
+    settings.beginGroup("Parameters");
+    for(auto &f : simFields)
+    {
+        if(settings.contains(f.name))
+            m_values[f.name] = settings.value(f.name).toDouble();
+    }
+    for(auto &f : firmwareFields)
+    {
+        if(settings.contains(f.name))
+            m_firmwareValues[f.name] = settings.value(f.name).toDouble();
+    }
+    settings.endGroup();
+
+    m_opMode = int(m_values["opMode"]);
+    m_direction = int(m_values["direction"]);
+
+    if(m_values["LoopFreq"] <= 0)
+    {
+        m_error = "LoopFreq must be greater than zero";
+        return false;
+    }
+
+    //run sequence as a list of duration:torque pairs, e.g. segments=2:100, 2:0
+    //in dyno mode a third value gives the speed for the segment, e.g. segments=1:50:4000, 1:50:8000
+    //defaults to a single runTime long segment at torqueDemand
+    settings.beginGroup("Scenario");
+    QStringList segments = settings.value("segments").toStringList();
+
+    //optional steady state detection, steady= lists the channels that must settle
+    QStringList steady = settings.value("steady").toStringList();
+    m_steady = !steady.isEmpty();
+    for(int ch = 0; ch < SS_COUNT; ch++)
+        m_detector.setEnabled(ch, false);
+    for(const QString &name : steady)
+    {
+        int ch = SteadyStateDetector::channelIndex(name.trimmed().toLatin1().constData());
+        if(ch < 0)
+        {
+            m_error = "Unknown steady state channel: " + name;
+            return false;
+        }
+        m_detector.setEnabled(ch, true);
+    }
+    m_detector.setTolerance(settings.value("steadyTol", 0.005).toDouble(), settings.value("steadyAbsTol", 0.1).toDouble());
+    m_detector.setPeriods(settings.value("steadyPeriods", 3).toInt());
+    m_fastForward = settings.value("fastForward", 0).toInt() != 0;
+
+    //optional triggered capture, e.g. trigger=ocur>0.9, pwm_off>0.5, ifw>0, throttle~5, pre=0.005, post=0.02
+    if(!m_trigger.Parse(settings.value("trigger").toStringList().join(',')))
+    {
+        m_error = m_trigger.getError();
+        return false;
+    }
+    if(m_steady && m_trigger.isEnabled())
+    {
+        m_error = "steady and trigger can't be used together";
+        return false;
+    }
+
+    //flight recorder, dumps the last flightRecorder seconds on a fault, e.g. flightAssert=Iq>400, rpm>12000
+    m_flightSeconds = settings.value("flightRecorder", 1).toDouble();
+    m_flightAssert = settings.value("flightAssert").toStringList().join(',');
+    m_flightDump = settings.value("flightDump", fileName + ".flight.csv").toString();
+    FlightRecorder flight;
+    if(!flight.ParseAssertions(m_flightAssert))
+    {
+        m_error = flight.getError();
+        return false;
+    }
+
+    //firmware binary log, rotated to a new file every binLogRotate MB if given
+    m_binLog = settings.value("binLog", fileName + ".bin").toString();
+    m_binLogRotate = settings.value("binLogRotate", 0).toDouble();
+    settings.endGroup();
+
+    m_segments.clear();
+    for(const QString &seg : segments)
+    {
+        QStringList parts = seg.trimmed().split(':');
+        bool okDuration = false, okTorque = false;
+        bool okSpeed = true;
+        ScenarioSegment s;
+        s.dynoSpeed = qQNaN();
+        if(parts.size() == 2 || parts.size() == 3)
+        {
+            s.duration = parts[0].toDouble(&okDuration);
+            s.torqueDemand = parts[1].toDouble(&okTorque);
+            if(parts.size() == 3)
+                s.dynoSpeed = parts[2].toDouble(&okSpeed);
+        }
+        if(!okDuration || !okTorque || !okSpeed)
+        {
+            m_error = "Invalid scenario segment: " + seg;
+            return false;
+        }
+        m_segments.append(s);
+    }
+    if(m_segments.isEmpty())
+        m_segments.append({m_values["runTime"], m_values["torqueDemand"], qQNaN()});
+
+    return true;
+}
+
+//override a simulator or OpenInverter field by its file name, returns false for unknown names
+bool Scenario::setValue(const QString &name, double value)
+{
+    if(m_values.contains(name))
+    {
+        m_values[name] = value;
+        if(name == "opMode")
+            m_opMode = int(value);
+        else if(name == "direction")
+            m_direction = int(value);
+        return true;
+    }
+    for(auto &f : firmwareFields)
+    {
+        if(name == f.name)
+        {
+            m_firmwareValues[name] = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+//motor values not given in the file are taken from the firmware so that model and controller agree, as the GUI does
+double Scenario::getPoles(void)
+{
+    return m_firmwareValues.contains("Poles") ? m_firmwareValues["Poles"] : Param::GetFloat(Param::polepairs);
+}
+
+double Scenario::getFluxLinkage(void)
+{
+    return m_firmwareValues.contains("FluxLinkage") ? m_firmwareValues["FluxLinkage"] : Param::GetFloat(Param::fluxlinkage);
+}
+
+MotorModel *Scenario::CreateMotor(void)
+{
+    double poles = getPoles();
+    double fluxLink = getFluxLinkage();
+    double timestep = 1.0 / m_values["LoopFreq"];
+
+    MotorModel *motor = new MotorModel(m_values["wheelSize"], m_values["gearRatio"], m_values["RoadGradient"]/100.0, m_values["vehicleWeight"],
+                                       m_values["Lq"]/1000, m_values["Ld"]/1000, m_values["Rs"], poles, fluxLink/1000, timestep,
+                                       m_values["SyncDelay"]/1000000, m_values["SamplingPoint"]/100.0);
+    motor->setMechDivider(int(m_values["MechDivider"]));
+    motor->setMechInterp(m_values["MechInterp"] != 0);
+    motor->setIntegrator(int(m_values["Integrator"]));
+    motor->setTrigMode(int(m_values["TrigMode"]));
+    motor->setTrigCheck(m_values["TrigCheck"] != 0);
+    motor->setDyno(m_values["DynoMode"] != 0);
+    motor->setDynoSpeed(m_values["DynoSpeed"]);
+    return motor;
+}
+
+SimEngine *Scenario::CreateEngine(void)
+{
+    MotorModel *motor = CreateMotor();
+    SimEngine *engine = new SimEngine(motor, 1.0 / m_values["LoopFreq"], m_values["Vdc"]);
+    RunConfig config;
+    config.throttleRamps = m_values["ThrotRamps"] != 0;
+    config.extraCycleDelay = m_values["ExtraCycleDelay"] != 0;
+    config.addNoise = m_values["AddNoise"] != 0;
+    config.noiseAmp = m_values["NoiseAmp"];
+    engine->setRunConfig(config);
+    engine->getFlightRecorder().ParseAssertions(m_flightAssert); //checked by Load()
+    engine->setFlightRecorder(m_flightSeconds, m_flightDump);
+    BinaryLogWriter::terminalLog().setOutput(m_binLog, qint64(m_binLogRotate * 1024 * 1024)); //one per process, as the firmware terminal is
+    return engine;
+}
+
+void Scenario::ApplyFirmwareParams(void)
+{
+    for(auto &f : firmwareFields)
+    {
+        if(m_firmwareValues.contains(f.name))
+            Param::Set(f.param, FP_FROMFLT(m_firmwareValues[f.name]));
+    }
+    if(m_firmwareValues.contains("Poles"))
+        Param::Set(Param::respolepairs, FP_FROMFLT(m_firmwareValues["Poles"])); //force resolver pole pairs to match motor
+}
+
+//create an engine and take it through the same initialisation sequence as the GUI
+SimEngine *Scenario::StartEngine(void)
+{
+    SimEngine *engine = CreateEngine();
+    engine->InitFirmware();
+    ApplyFirmwareParams();
+    engine->setTorqueDemand(m_segments.first().torqueDemand);
+    engine->StartFirmware(m_opMode, m_direction);
+
+    //noise makes the start up state random so it is never cached
+    bool useCache = !m_warmStartDir.isEmpty() && m_values["AddNoise"] == 0;
+    WarmStartCache cache(m_warmStartDir);
+    SimSnapshot *snapshot = useCache ? cache.Load(getWarmStartKey(), engine) : nullptr;
+    bool restored = snapshot && engine->Restore(snapshot);
+    delete snapshot;
+    if(restored)
+        return engine; //otherwise a cold start, which replaces the cache entry
+
+    engine->RunFor(8789);
+    engine->Restart(m_opMode);
+    if(useCache && FirmwareContext::isSupported())
+    {
+        snapshot = engine->Snapshot();
+        cache.Save(getWarmStartKey(), snapshot);
+        delete snapshot;
+    }
+    return engine;
+}
+
+//everything that feeds the start up sequence, the run segments after the first don't
+QByteArray Scenario::getWarmStartKey(void)
+{
+    QByteArray key;
+    QDataStream out(&key, QIODevice::WriteOnly);
+    out << m_values << m_firmwareValues; //sorted by name so the key doesn't depend on file order
+    out << m_opMode << m_direction << m_segments.first().torqueDemand;
+    return key;
+}
+
+void Scenario::RunSegments(SimEngine *engine, TraceRecorder *recorder)
+{
+    int total_steps = 0;
+    for(const ScenarioSegment &seg : m_segments)
+        total_steps += int(seg.duration/engine->getTimestep());
+    if(recorder && !m_trigger.isEnabled())
+        recorder->reserve(total_steps); //one allocation for the whole scenario
+    m_trigger.Reset(engine->getTimestep()); //a throttle step between segments is seen as one
+
+    m_steadyResults.clear();
+    for(const ScenarioSegment &seg : m_segments)
+    {
+        int steps = int(seg.duration/engine->getTimestep());
+        engine->setTorqueDemand(seg.torqueDemand);
+        if(!qIsNaN(seg.dynoSpeed))
+        {
+            if(m_values["DynoRamp"] > 0)
+                engine->getMotor()->setDynoRamp(seg.dynoSpeed, m_values["DynoRamp"]);
+            else
+                engine->getMotor()->setDynoSpeed(seg.dynoSpeed);
+        }
+        if(m_trigger.isEnabled())
+        {
+            engine->RunTriggered(steps, &m_trigger, recorder);
+            continue;
+        }
+        if(!m_steady)
+        {
+            engine->RunFor(steps, recorder);
+            continue;
+        }
+
+        SteadyStateDetector detector = m_detector;
+        detector.Reset();
+        int run = engine->RunUntilSteady(steps, &detector, recorder);
+
+        SteadyResult result;
+        result.steady = detector.isSteady();
+        result.time = engine->getTime();
+        for(int ch = 0; ch < SS_COUNT; ch++)
+            result.values[ch] = detector.getValue(ch);
+        m_steadyResults.append(result);
+
+        //speed carries on at its measured rate, zero in a fixed speed run
+        if(result.steady && m_fastForward && run < steps)
+            engine->FastForward((steps - run) * engine->getTimestep(), detector.getSlope(SS_SPEED));
+    }
+}
+
+void Scenario::WriteSteadyReport(QTextStream &out)
+{
+    out << "segment,steady,time";
+    for(int ch = 0; ch < SS_COUNT; ch++)
+        out << ',' << SteadyStateDetector::channelName(ch);
+    out << '\n';
+
+    for(int i = 0; i < m_steadyResults.size(); i++)
+    {
+        const SteadyResult &r = m_steadyResults[i];
+        out << i << ',' << (r.steady ? 1 : 0) << ',' << r.time;
+        for(int ch = 0; ch < SS_COUNT; ch++)
+            out << ',' << r.values[ch];
+        out << '\n';
+    }
+}
+
+void Scenario::WriteTriggerReport(QTextStream &out)
+{
+    out << "event,time,condition\n";
+    const QList<TriggerEvent> &events = m_trigger.getEvents();
+    for(int i = 0; i < events.size(); i++)
+        out << i << ',' << events[i].time << ',' << m_trigger.describe(events[i].condition) << '\n';
+}
@@ -0,0 +1,99 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <QString>
+#include <QList>
+#include <QMap>
+#include <QTextStream>
+#include "simengine.h"
+#include "steadystate.h"
+#include "triggercapture.h"
+
+struct ScenarioSegment
+{
+    double duration; //s
+    double torqueDemand; //%
+    double dynoSpeed; //rpm, NaN to leave the speed alone
+};
+
+struct SteadyResult
+{
+    bool steady;
+    double time; //s, when the segment settled or ended
+    double values[SS_COUNT]; //mean over the last electrical period
+};
+
+//Parameter/scenario file for the headless runner
+//INI format, [Parameters] uses the same names and units as the GUI fields, [Scenario] holds the run sequence
+class Scenario
+{
+public:
+    Scenario();
+    bool Load(const QString &fileName);
+    QString getError(void) {return m_error;}
+    MotorModel *CreateMotor(void);
+    double getPoles(void); //from the file, or the firmware default as the GUI does
+    double getFluxLinkage(void); //mWb
+    SimEngine *CreateEngine(void);
+    void ApplyFirmwareParams(void);
+    SimEngine *StartEngine(void);
+    void setWarmStartCache(const QString &directory) {m_warmStartDir = directory;} //empty to always run the start up sequence
+    QByteArray getWarmStartKey(void);
+    bool isSteadyEnabled(void) {return m_steady;}
+    const SteadyStateDetector &getSteadyDetector(void) {return m_detector;}
+    const QList<SteadyResult> &getSteadyResults(void) {return m_steadyResults;}
+    void WriteSteadyReport(QTextStream &out);
+    bool isTriggerEnabled(void) {return m_trigger.isEnabled();}
+    const TriggerCapture &getTrigger(void) {return m_trigger;}
+    void WriteTriggerReport(QTextStream &out);
+    QString getFileName(void) {return m_fileName;}
+    void setFlightDump(const QString &fileName) {m_flightDump = fileName;}
+    void setBinaryLog(const QString &fileName) {m_binLog = fileName;}
+    void RunSegments(SimEngine *engine, TraceRecorder *recorder);
+    const QList<ScenarioSegment> &getSegments(void) {return m_segments;}
+    int getOpMode(void) {return m_opMode;}
+    int getDirection(void) {return m_direction;}
+    double getValue(const QString &name) {return m_values.value(name);}
+    bool setValue(const QString &name, double value);
+
+private:
+    QMap<QString, double> m_values;
+    QMap<QString, double> m_firmwareValues;
+    QList<ScenarioSegment> m_segments;
+    int m_opMode;
+    int m_direction;
+    QString m_warmStartDir;
+    bool m_steady; //end each segment once steady
+    bool m_fastForward; //jump to the end of a steady segment rather than stopping it
+    SteadyStateDetector m_detector; //settings for each segment's detector
+    QList<SteadyResult> m_steadyResults;
+    TriggerCapture m_trigger; //only the windows around its events are recorded
+    QString m_fileName;
+    double m_flightSeconds; //flight recorder length, 0=off
+    QString m_flightAssert;
+    QString m_flightDump;
+    QString m_binLog; //firmware binary log, only written if the firmware turns binary logging on
+    double m_binLogRotate; //MB, 0=one file
+    QString m_error;
+};
+
+#endif // SCENARIO_H
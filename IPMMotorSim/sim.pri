@@ -0,0 +1,73 @@
+#-------------------------------------------------
+#
+# Simulation core shared by the GUI and the headless runner.
+# Contains the motor model, the simulation engine, the test stubs and
+# the stm32-sine firmware sources.  No widgets or charts in here.
+#
+#-------------------------------------------------
+
+DEFINES += QT_DEPRECATED_WARNINGS
+DEFINES += CTRL_FOC=1
+DEFINES += CTRL_SINE=0
+DEFINES += CONTROL=1
+
+DEFINES += STM32F1
+
+CONFIG += c++11
+
+# Firmware/test stub globals gathered into one region so snapshots can copy them (GNU ld)
+# Not position independent so the region, and any pointers held in it, is at the same address every run (warm start cache)
+linux {
+    QMAKE_LFLAGS += -Wl,-T,$$PWD/fwstate.ld -no-pie
+    DEFINES += SIM_FWSTATE_REGION
+}
+
+# Trace channels are stored as float unless the project sets CONFIG += trace_double
+trace_double: DEFINES += TRACE_DOUBLE
+
+INCLUDEPATH += $$PWD
+INCLUDEPATH += $$PWD/stm32-sine/include
+INCLUDEPATH += $$PWD/stm32-sine/libopencm3/include
+INCLUDEPATH += $$PWD/stm32-sine/libopeninv/include
+
+SOURCES += \
+    $$PWD/motormodel.cpp \
+    $$PWD/motormodelbatch.cpp \
+    $$PWD/batchcheck.cpp \
+    $$PWD/simengine.cpp \
+    $$PWD/firmwarecontext.cpp \
+    $$PWD/tracerecorder.cpp \
+    $$PWD/warmstartcache.cpp \
+    $$PWD/steadystate.cpp \
+    $$PWD/triggercapture.cpp \
+    $$PWD/flightrecorder.cpp \
+    $$PWD/binlogwriter.cpp \
+    $$PWD/stm32-sine/libopeninv/src/params.cpp \
+    $$PWD/stm32-sine/libopeninv/src/picontroller.cpp \
+    $$PWD/stm32-sine/libopeninv/src/sine_core.cpp \
+    $$PWD/stm32-sine/src/pwmgeneration-foc.cpp \
+    $$PWD/stm32-sine/libopeninv/src/my_string.c \
+    $$PWD/stm32-sine/libopeninv/src/errormessage.cpp \
+    $$PWD/stm32-sine/libopeninv/src/foc.cpp \
+    $$PWD/teststubs.c \
+    $$PWD/cpp_teststubs.cpp \
+    $$PWD/stm32-sine/src/pwmgeneration.cpp \
+    $$PWD/terminal_stubs.cpp
+
+DISTFILES += \
+    $$PWD/fwstate.ld
+
+HEADERS += \
+    $$PWD/motormodel.h \
+    $$PWD/motormodelbatch.h \
+    $$PWD/batchcheck.h \
+    $$PWD/simengine.h \
+    $$PWD/firmwarecontext.h \
+    $$PWD/tracerecorder.h \
+    $$PWD/warmstartcache.h \
+    $$PWD/steadystate.h \
+    $$PWD/triggercapture.h \
+    $$PWD/flightrecorder.h \
+    $$PWD/binlogwriter.h \
+    $$PWD/stm32-sine/include/pwmgeneration.h \
+    $$PWD/teststubs.h
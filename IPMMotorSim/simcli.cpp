@@ -0,0 +1,182 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QFile>
+#include <QThread>
+#include "scenario.h"
+#include "convergence.h"
+#include "batchcheck.h"
+#include "sweep.h"
+#include "efficiencymap.h"
+#include "simengine.h"
+#include "tracerecorder.h"
+#include "warmstartcache.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("IPMMotorSimCli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless IPM motor simulator");
+    parser.addHelpOption();
+    parser.addPositionalArgument("scenario", "Parameter/scenario file (INI format)");
+    QCommandLineOption outputOption(QStringList() << "o" << "output", "Trace output file (CSV).", "file", "traces.csv");
+    QCommandLineOption everyOption(QStringList() << "e" << "every", "Only write every Nth step to the trace file.", "N", "1");
+    QCommandLineOption convergenceOption("convergence", "Print an integrator convergence report over the given run time instead of running the scenario.", "seconds");
+    QCommandLineOption batchCheckOption("batch-check", "Run N open loop motors for runTime through the batch model and through MotorModel, and report the difference.", "N");
+    QCommandLineOption sweepOption("sweep", "Run the [Sweep] parameter grid, one process per point, and write a results table.");
+    QCommandLineOption mapOption("map", "Run the [Map] torque/speed grid to steady state, one process per point, and write an efficiency map.");
+    QCommandLineOption jobsOption(QStringList() << "j" << "jobs", "Number of sweep worker processes (default one per core).", "N", QString::number(QThread::idealThreadCount()));
+    QCommandLineOption resultsOption("results", "Sweep result file, an existing file for the same sweep is resumed.", "file");
+    QCommandLineOption restartOption("restart", "Ignore any existing sweep results and start again.");
+    QCommandLineOption warmCacheOption("warm-cache", "Directory of saved start up states.", "dir", WarmStartCache::defaultDirectory());
+    QCommandLineOption noWarmCacheOption("no-warm-cache", "Always run the firmware start up sequence.");
+    QCommandLineOption channelsOption("channels", "Only record and write these trace channels, comma separated (default all).", "names");
+    parser.addOption(outputOption);
+    parser.addOption(everyOption);
+    parser.addOption(convergenceOption);
+    parser.addOption(batchCheckOption);
+    parser.addOption(sweepOption);
+    parser.addOption(mapOption);
+    parser.addOption(jobsOption);
+    parser.addOption(resultsOption);
+    parser.addOption(restartOption);
+    parser.addOption(warmCacheOption);
+    parser.addOption(noWarmCacheOption);
+    parser.addOption(channelsOption);
+    parser.process(app);
+
+    QTextStream err(stderr);
+    if(parser.positionalArguments().size() != 1)
+    {
+        err << "A single scenario file must be given\n";
+        return 1;
+    }
+
+    Scenario scenario;
+    if(!scenario.Load(parser.positionalArguments().at(0)))
+    {
+        err << scenario.getError() << "\n";
+        return 1;
+    }
+
+    if(!parser.isSet(noWarmCacheOption))
+    {
+        scenario.setWarmStartCache(parser.value(warmCacheOption));
+        WarmStartCache::buildId(); //hash the executable once here rather than in every sweep worker
+    }
+
+    if(parser.isSet(convergenceOption))
+    {
+        QTextStream out(stdout);
+        ConvergenceReport(scenario, parser.value(convergenceOption).toDouble(), out);
+        return 0;
+    }
+
+    if(parser.isSet(batchCheckOption))
+    {
+        QTextStream out(stdout);
+        if(!BatchCheckReport(scenario, parser.value(batchCheckOption).toInt(), scenario.getValue("runTime"), out))
+        {
+            err << "Batch model reference mode doesn't match MotorModel\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    if(parser.isSet(sweepOption) || parser.isSet(mapOption))
+    {
+        Sweep grid;
+        EfficiencyMap map;
+        Sweep &sweep = parser.isSet(mapOption) ? map : grid;
+        QString scenarioFile = parser.positionalArguments().at(0);
+        QString resultFile = parser.isSet(resultsOption) ? parser.value(resultsOption) : scenarioFile + (parser.isSet(mapOption) ? ".map" : ".sweep");
+        if(!sweep.Load(scenarioFile, scenario) || !sweep.Run(resultFile, parser.value(jobsOption).toInt(), !parser.isSet(restartOption), err))
+        {
+            err << sweep.getError() << "\n";
+            return 1;
+        }
+
+        QFile tableFile(parser.value(outputOption));
+        QTextStream out(stdout);
+        if(parser.isSet(outputOption))
+        {
+            if(!tableFile.open(QFile::WriteOnly | QFile::Text))
+            {
+                err << "Unable to write " << tableFile.fileName() << "\n";
+                return 1;
+            }
+            out.setDevice(&tableFile);
+        }
+        if(!sweep.WriteTable(resultFile, out))
+        {
+            err << sweep.getError() << "\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    TraceRecorder recorder;
+    if(parser.isSet(channelsOption))
+    {
+        ChannelMask channels = 0;
+        for(const QString &name : parser.value(channelsOption).split(','))
+        {
+            int ch = TraceRecorder::channelIndex(name.trimmed().toLatin1().constData());
+            if(ch == TR_COUNT)
+            {
+                err << "Unknown trace channel: " << name << "\n";
+                return 1;
+            }
+            if(ch != TR_TIME) //always written
+                channels |= TR_CHANNEL(ch);
+        }
+        recorder.subscribe(&parser, channels);
+    }
+
+    SimEngine *engine = scenario.StartEngine();
+    scenario.RunSegments(engine, &recorder);
+    if(scenario.isSteadyEnabled())
+    {
+        QTextStream out(stdout);
+        scenario.WriteSteadyReport(out);
+    }
+    if(scenario.isTriggerEnabled())
+    {
+        QTextStream out(stdout);
+        scenario.WriteTriggerReport(out);
+    }
+    FlightRecorder &flight = engine->getFlightRecorder();
+    if(flight.getDumps() > 0)
+        err << "Flight recorder: " << flight.getFaultReason() << ", written to " << flight.getDumpFile() << "\n";
+    if(scenario.getValue("TrigCheck") != 0)
+        err << "Max trig error against reference: " << engine->getMotor()->getTrigMaxError() << "\n";
+    delete engine;
+
+    if(!recorder.writeCsv(parser.value(outputOption), qMax(1, parser.value(everyOption).toInt())))
+    {
+        err << "Unable to write trace file " << parser.value(outputOption) << "\n";
+        return 1;
+    }
+    return 0;
+}
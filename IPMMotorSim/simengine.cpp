@@ -0,0 +1,429 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "simengine.h"
+#include <QRandomGenerator>
+#include <string.h>
+#include "pwmgeneration.h"
+#include "foc.h"
+#include "params.h"
+#include "inc_encoder.h"
+#include "teststubs.h"
+#include "my_math.h"
+
+#define GPIOA 0
+#define GPIOB 1
+#define GPIOC 2
+#include "anain.h"
+
+#define TWO_PI_CONT 65536
+
+//c++ test stubs globals
+extern volatile uint16_t g_input_angle;
+extern volatile double g_il1_input;
+extern volatile double g_il2_input;
+
+// C test stubs globals
+extern volatile bool disablePWM;
+
+SimEngine::SimEngine(MotorModel *motor, double timestep, double vdc)
+    :m_motor{motor}, m_time{0}, m_stepTime{0}, m_timestep{timestep}, m_Vdc{vdc}, m_old_time{0}, m_old_ms_time{0}, m_oldVa{0}, m_oldVb{0}, m_oldVc{0},
+      m_ctrlVa{0}, m_ctrlVb{0}, m_ctrlVc{0}, m_Va{0}, m_Vb{0}, m_Vc{0},
+      m_lastTorqueDemand{0}
+{
+    m_motor->setTimestep(m_timestep);
+    SelectLoop();
+}
+
+SimEngine::~SimEngine()
+{
+    delete m_motor;
+}
+
+//set any parameters that can upset simulation to safe values
+void SimEngine::InitFirmware(void)
+{
+    ANA_IN_CONFIGURE(ANA_IN_LIST);
+
+    Param::SetInt(Param::syncofs,0); //simulator assumes perfect alignment
+    Param::SetInt(Param::pinswap,0); //shouldn't be a problem but may be in the future
+    Param::SetInt(Param::respolepairs,Param::GetInt(Param::polepairs)); //force resolver pole pairs to match motor
+    Param::SetFloat(Param::udc, m_Vdc);
+}
+
+void SimEngine::StartFirmware(int opmode, int dir)
+{
+    //following block copied from OpenInverter - probably not needed
+    Param::SetInt(Param::version, 4); //backward compatibility
+
+    if (Param::GetInt(Param::snsm) < 12)
+        Param::SetInt(Param::snsm, Param::GetInt(Param::snsm) + 10); //upgrade parameter
+    if (Param::Get(Param::offthrotregen) > 0)
+        Param::Set(Param::offthrotregen, -Param::Get(Param::offthrotregen));
+
+    Param::Change(Param::PARAM_LAST);
+    Param::Change(Param::nodeid);
+
+    PwmGeneration::SetOpmode(0);
+    PwmGeneration::SetOpmode(opmode);
+    Param::SetInt(Param::dir, dir);
+
+    FOC::SetMotorParameters(Param::GetFloat(Param::lqminusld)/1000, Param::GetFloat(Param::fluxlinkage)/1000);
+
+    PwmGeneration::SetTorquePercent(m_config.torqueDemand);
+}
+
+void SimEngine::setVdc(double val)
+{
+    m_Vdc = val;
+    Param::SetFloat(Param::udc, m_Vdc);
+}
+
+void SimEngine::Step(void)
+{
+    RunStep();
+}
+
+//point m_step and m_loop at the versions compiled for the current flags
+void SimEngine::SelectLoop(void)
+{
+    static const StepFunction steps[8] =
+    {
+        &SimEngine::SpecialisedStep<false, false, false>, &SimEngine::SpecialisedStep<false, false, true>,
+        &SimEngine::SpecialisedStep<false, true, false>, &SimEngine::SpecialisedStep<false, true, true>,
+        &SimEngine::SpecialisedStep<true, false, false>, &SimEngine::SpecialisedStep<true, false, true>,
+        &SimEngine::SpecialisedStep<true, true, false>, &SimEngine::SpecialisedStep<true, true, true>
+    };
+    static const LoopFunction loops[8] =
+    {
+        &SimEngine::SpecialisedLoop<false, false, false>, &SimEngine::SpecialisedLoop<false, false, true>,
+        &SimEngine::SpecialisedLoop<false, true, false>, &SimEngine::SpecialisedLoop<false, true, true>,
+        &SimEngine::SpecialisedLoop<true, false, false>, &SimEngine::SpecialisedLoop<true, false, true>,
+        &SimEngine::SpecialisedLoop<true, true, false>, &SimEngine::SpecialisedLoop<true, true, true>
+    };
+    int index = (m_config.throttleRamps ? 4 : 0) | (m_config.extraCycleDelay ? 2 : 0) | (m_config.addNoise ? 1 : 0);
+    m_step = steps[index];
+    m_loop = loops[index];
+}
+
+//single simulation step
+template<bool throttleRamps, bool extraCycleDelay, bool addNoise>
+void SimEngine::SpecialisedStep(void)
+{
+    m_stepTime = m_time;
+
+    //routines that need calling every 10ms
+    if((uint32_t)(m_time*100) != m_old_time)
+    {
+        m_old_time = (uint32_t)(m_time*100);
+        Encoder::UpdateRotorFrequency(100);
+
+        if(throttleRamps)
+        {
+            int requestedTorque = qRound(m_config.torqueDemand * 100);
+            //ramps set at 5% above 0 and 0.5% below
+            if(m_lastTorqueDemand != requestedTorque)
+            {
+                if(requestedTorque > m_lastTorqueDemand)
+                    requestedTorque = RAMPUP(m_lastTorqueDemand, requestedTorque, ((m_lastTorqueDemand>=0)?500:50));
+                else
+                    requestedTorque = RAMPDOWN(m_lastTorqueDemand, requestedTorque, ((m_lastTorqueDemand>=0)?500:50));
+                m_lastTorqueDemand = requestedTorque;
+            }
+            PwmGeneration::SetTorquePercent(((float)(m_lastTorqueDemand+50))/100);
+        }
+        else
+            PwmGeneration::SetTorquePercent(m_config.torqueDemand);
+    }
+
+    //routines that need calling every ms
+    if((uint32_t)(m_time*1000) != m_old_ms_time)
+    {
+        m_old_ms_time = (uint32_t)(m_time*1000);
+        //not used at the moment but left in for future use
+    }
+
+    g_input_angle = (uint16_t)((m_motor->getElecPosition()*TWO_PI_CONT)/360.0);
+    if(disablePWM)
+    {
+        g_il1_input = 0;
+        g_il2_input = 0;
+    }
+    else
+    {
+        g_il1_input = (Param::GetFloat(Param::il1gain)*m_motor->getIaSamp());
+        g_il2_input = (Param::GetFloat(Param::il2gain)*m_motor->getIbSamp());
+    }
+
+    if(addNoise)
+    {
+        g_il1_input += QRandomGenerator::global()->bounded(m_config.noiseAmp) - (m_config.noiseAmp/2);
+        g_il2_input += QRandomGenerator::global()->bounded(m_config.noiseAmp) - (m_config.noiseAmp/2);
+    }
+
+    PwmGeneration::Run();
+
+    if(disablePWM) //needed to allow OpeinInverter initialisation to complete
+    {
+        m_ctrlVa = 0;
+        m_ctrlVb = 0;
+        m_ctrlVc = 0;
+    }
+    else
+    {
+        m_ctrlVa = (m_Vdc/65536) * (FOC::DutyCycles[0]-32768);
+        m_ctrlVb = (m_Vdc/65536) * (FOC::DutyCycles[1]-32768);
+        m_ctrlVc = (m_Vdc/65536) * (FOC::DutyCycles[2]-32768);
+    }
+
+    //remove space vector modulation
+    double offset = m_ctrlVa + m_ctrlVb + m_ctrlVc;
+    m_Va = m_ctrlVa - offset/3;
+    m_Vb = m_ctrlVb - offset/3;
+    m_Vc = m_ctrlVc - offset/3;
+
+    //one period delay to simulate slow timer reload in target hardware
+    if(extraCycleDelay)
+        m_motor->Step(m_oldVa,m_oldVb,m_oldVc);
+    else
+        m_motor->Step(m_Va,m_Vb,m_Vc);
+    m_oldVa = m_Va;
+    m_oldVb = m_Vb;
+    m_oldVc = m_Vc;
+
+    if(m_flight.isEnabled())
+        FlightSample();
+
+    m_time += m_timestep;
+}
+
+template<bool throttleRamps, bool extraCycleDelay, bool addNoise>
+void SimEngine::SpecialisedLoop(int num_steps, TraceRecorder *recorder)
+{
+    if(!recorder)
+    {
+        for(int i = 0;i<num_steps; i++)
+            SpecialisedStep<throttleRamps, extraCycleDelay, addNoise>();
+        return;
+    }
+
+    recorder->reserve(num_steps); //only allocation for the whole run
+    for(int i = 0;i<num_steps; i++)
+    {
+        SpecialisedStep<throttleRamps, extraCycleDelay, addNoise>();
+        Record(recorder);
+    }
+}
+
+void SimEngine::RunFor(int num_steps, TraceRecorder *recorder)
+{
+    (this->*m_loop)(num_steps, recorder);
+}
+
+int SimEngine::RunUntilSteady(int max_steps, SteadyStateDetector *detector, TraceRecorder *recorder)
+{
+    if(recorder)
+        recorder->reserve(max_steps);
+
+    double values[SS_COUNT];
+    for(int i = 0;i<max_steps; i++)
+    {
+        RunStep();
+        if(recorder)
+            Record(recorder);
+
+        values[SS_IQ] = m_motor->getIq();
+        values[SS_ID] = m_motor->getId();
+        values[SS_SPEED] = m_motor->getMotorFreq()*60;
+        values[SS_UD] = Param::GetFloat(Param::ud);
+        values[SS_UQ] = Param::GetFloat(Param::uq);
+        if(detector->Sample(m_stepTime, m_motor->getElecPosition(), values))
+            return i + 1;
+    }
+    return max_steps;
+}
+
+//every step is recorded into the trigger's ring, it passes the windows it captures on to the recorder
+void SimEngine::RunTriggered(int num_steps, TriggerCapture *trigger, TraceRecorder *recorder)
+{
+    trigger->setChannels(recorder ? recorder->enabledChannels() : 0);
+
+    double values[TG_COUNT];
+    for(int i = 0;i<num_steps; i++)
+    {
+        RunStep();
+        Record(trigger->getRing());
+
+        double ocurlim = qAbs(Param::GetFloat(Param::ocurlim));
+        double peak = qMax(qAbs(m_motor->getIaSamp()), qMax(qAbs(m_motor->getIbSamp()), qAbs(m_motor->getIcSamp())));
+        values[TG_OCUR] = (ocurlim > 0) ? (peak / ocurlim) : 0;
+        values[TG_PWM_OFF] = disablePWM ? 1 : 0;
+        values[TG_IQ] = m_motor->getIq();
+        values[TG_ID] = m_motor->getId();
+        values[TG_IFW] = Param::GetFloat(Param::ifw);
+        values[TG_THROTTLE] = m_config.torqueDemand;
+        trigger->Sample(values, recorder);
+    }
+}
+
+void SimEngine::setFlightRecorder(double seconds, const QString &dumpFile)
+{
+    m_flight.setLength(seconds);
+    m_flight.setDumpFile(dumpFile);
+    m_flight.Reset(m_timestep);
+}
+
+//step state for the flight recorder
+void SimEngine::FlightSample(void)
+{
+    float values[FR_COUNT];
+    values[FR_IA] = m_motor->getIaSamp();
+    values[FR_IB] = m_motor->getIbSamp();
+    values[FR_IC] = m_motor->getIcSamp();
+    values[FR_IQ] = m_motor->getIq();
+    values[FR_ID] = m_motor->getId();
+    values[FR_VD] = m_motor->getVd();
+    values[FR_VQ] = m_motor->getVq();
+    values[FR_ELEC_POS] = m_motor->getElecPosition();
+    values[FR_RPM] = m_motor->getMotorFreq()*60;
+    values[FR_TORQUE] = m_motor->getTorque();
+    values[FR_CONT_IQ] = Param::GetFloat(Param::iq);
+    values[FR_CONT_ID] = Param::GetFloat(Param::id);
+    values[FR_CONT_UD] = Param::GetFloat(Param::ud);
+    values[FR_CONT_UQ] = Param::GetFloat(Param::uq);
+    values[FR_CONT_IFW] = Param::GetFloat(Param::ifw);
+    values[FR_DUTY_A] = FOC::DutyCycles[0];
+    values[FR_DUTY_B] = FOC::DutyCycles[1];
+    values[FR_DUTY_C] = FOC::DutyCycles[2];
+    values[FR_PWM_OFF] = disablePWM ? 1 : 0;
+    values[FR_DEMAND] = m_config.torqueDemand;
+    m_flight.Sample(m_stepTime, values);
+}
+
+void SimEngine::Record(TraceRecorder *recorder)
+{
+    double vscale = m_Vdc/65536;
+
+    recorder->set(TR_IA, m_motor->getIaSamp());
+    recorder->set(TR_IB, m_motor->getIbSamp());
+    recorder->set(TR_IC, m_motor->getIcSamp());
+    recorder->set(TR_IQ, m_motor->getIq());
+    recorder->set(TR_ID, m_motor->getId());
+
+    recorder->set(TR_ELEC_FREQ, m_motor->getMotorFreq()*m_motor->getPoles());
+    recorder->set(TR_MOTOR_POS, m_motor->getMotorPosition());
+    recorder->set(TR_CONT_POS, (360.0 * PwmGeneration::GetAngle())/TWO_PI_CONT);
+
+    //controller voltages including SVM so that we see the SVM waveforms
+    recorder->set(TR_CVA, m_ctrlVa);
+    recorder->set(TR_CVB, m_ctrlVb);
+    recorder->set(TR_CVC, m_ctrlVc);
+    recorder->set(TR_CVQ, vscale * Param::GetFloat(Param::uq));
+    recorder->set(TR_CVD, vscale * Param::GetFloat(Param::ud));
+    recorder->set(TR_CIQ, Param::GetFloat(Param::iq));
+    recorder->set(TR_CID, Param::GetFloat(Param::id));
+    recorder->set(TR_CIFW, Param::GetFloat(Param::ifw));
+
+    recorder->set(TR_VD, m_motor->getVd());
+    recorder->set(TR_VQ, m_motor->getVq());
+    recorder->set(TR_VQ_BEMF, m_motor->getVq_bemf());
+    recorder->set(TR_VQ_DT_ID, m_motor->getVq_dueto_id());
+    recorder->set(TR_VD_DT_IQ, m_motor->getVd_dueto_iq());
+    recorder->set(TR_VQ_DT_RQ, m_motor->getVq_dueto_Rq());
+    recorder->set(TR_VD_DT_RD, m_motor->getVd_dueto_Rd());
+    recorder->set(TR_VLD, m_motor->getVLd());
+    recorder->set(TR_VLQ, m_motor->getVLq());
+
+    recorder->set(TR_POWER, m_motor->getPower()/1000);
+    recorder->set(TR_TORQUE, m_motor->getTorque());
+    recorder->set(TR_SHAFT_RPM, m_motor->getMotorFreq()*60);
+    if(recorder->isEnabled(TR_ELEC_POWER) || recorder->isEnabled(TR_EFFICIENCY))
+    {
+        double elec_power = (m_Va * m_motor->getIaSamp()) + (m_Vb * m_motor->getIbSamp()) + (m_Vc * m_motor->getIcSamp());
+        recorder->set(TR_ELEC_POWER, elec_power/1000);
+        recorder->set(TR_EFFICIENCY, 100.0 * (m_motor->getPower()/elec_power));
+    }
+
+    recorder->commit(m_stepTime);
+}
+
+void SimEngine::Restart(int opmode)
+{
+    m_motor->Restart();
+    double demand = m_config.torqueDemand;
+    m_config.torqueDemand = 0;
+    PwmGeneration::SetOpmode(0);
+    PwmGeneration::SetOpmode(opmode); //reset controller integrators
+    PwmGeneration::SetTorquePercent(0);
+    for(int i = 0;i<6000; i++) //allow controller to complete initialisation
+        RunStep();
+    m_config.torqueDemand = demand;
+    PwmGeneration::SetTorquePercent(m_config.torqueDemand);
+    testStubsClearEncoder();
+    m_time = 0;
+    m_stepTime = 0;
+    m_motor->Restart();
+    m_flight.Reset(m_timestep); //nothing from before the restart, and the start up steps aren't faults
+}
+
+//firmware state can only be captured when it is collected into one region, see FirmwareContext
+SimSnapshot *SimEngine::Snapshot(void)
+{
+    SimSnapshot *snapshot = new SimSnapshot(*m_motor);
+    snapshot->firmware = QByteArray(FirmwareContext::stateData(), FirmwareContext::stateSize());
+    snapshot->time = m_time;
+    snapshot->stepTime = m_stepTime;
+    snapshot->oldTime = m_old_time;
+    snapshot->oldMsTime = m_old_ms_time;
+    snapshot->oldVa = m_oldVa;
+    snapshot->oldVb = m_oldVb;
+    snapshot->oldVc = m_oldVc;
+    snapshot->ctrlVa = m_ctrlVa;
+    snapshot->ctrlVb = m_ctrlVb;
+    snapshot->ctrlVc = m_ctrlVc;
+    snapshot->Va = m_Va;
+    snapshot->Vb = m_Vb;
+    snapshot->Vc = m_Vc;
+    snapshot->lastTorqueDemand = m_lastTorqueDemand;
+    return snapshot;
+}
+
+bool SimEngine::Restore(const SimSnapshot *snapshot)
+{
+    if(snapshot->firmware.size() != FirmwareContext::stateSize())
+        return false; //motor state against the wrong controller state is worse than no restore
+    memcpy(FirmwareContext::stateData(), snapshot->firmware.constData(), snapshot->firmware.size());
+    *m_motor = snapshot->motor;
+    m_time = snapshot->time;
+    m_stepTime = snapshot->stepTime;
+    m_old_time = snapshot->oldTime;
+    m_old_ms_time = snapshot->oldMsTime;
+    m_oldVa = snapshot->oldVa;
+    m_oldVb = snapshot->oldVb;
+    m_oldVc = snapshot->oldVc;
+    m_ctrlVa = snapshot->ctrlVa;
+    m_ctrlVb = snapshot->ctrlVb;
+    m_ctrlVc = snapshot->ctrlVc;
+    m_Va = snapshot->Va;
+    m_Vb = snapshot->Vb;
+    m_Vc = snapshot->Vc;
+    m_lastTorqueDemand = snapshot->lastTorqueDemand;
+    m_flight.Reset(m_timestep);
+    return true;
+}
@@ -0,0 +1,133 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIMENGINE_H
+#define SIMENGINE_H
+
+#include <stdint.h>
+#include <QByteArray>
+#include "motormodel.h"
+#include "tracerecorder.h"
+#include "firmwarecontext.h"
+#include "steadystate.h"
+#include "triggercapture.h"
+#include "flightrecorder.h"
+
+//Complete simulation state, restoring it is a straight memory copy rather than a re-run of the warm up
+//Engine settings (timestep, Vdc, torque demand, noise etc.) are not part of the state
+struct SimSnapshot
+{
+    SimSnapshot(const MotorModel &m) :motor(m) {}
+    QByteArray firmware; //Param values, controller integrators, encoder/ADC stub inputs and disablePWM
+    MotorModel motor;
+    double time, stepTime;
+    uint32_t oldTime, oldMsTime;
+    double oldVa, oldVb, oldVc;
+    double ctrlVa, ctrlVb, ctrlVc;
+    double Va, Vb, Vc;
+    int lastTorqueDemand;
+};
+
+//Run options, fixed for the length of a run
+//The step loop is compiled once for each combination of the flags so the per step path doesn't test them
+struct RunConfig
+{
+    RunConfig() :torqueDemand{0}, throttleRamps{false}, extraCycleDelay{false}, addNoise{false}, noiseAmp{0} {}
+    double torqueDemand;
+    bool throttleRamps;
+    bool extraCycleDelay;
+    bool addNoise;
+    double noiseAmp;
+};
+
+//GUI free simulation loop, couples the motor model to the stm32-sine firmware
+//Used by both MainWindow and the headless command line runner
+//The firmware keeps its state in globals, so there is one engine per process
+//Runs are spread over several cores by the forked sweep/map workers (--jobs), each with its own copy of the globals
+class SimEngine
+{
+public:
+    SimEngine(MotorModel *motor, double timestep, double vdc);
+    ~SimEngine();
+    void InitFirmware(void);
+    void StartFirmware(int opmode, int dir);
+    void Step(void);
+    void RunFor(int num_steps, TraceRecorder *recorder = nullptr);
+    int RunUntilSteady(int max_steps, SteadyStateDetector *detector, TraceRecorder *recorder = nullptr); //returns steps run
+    void RunTriggered(int num_steps, TriggerCapture *trigger, TraceRecorder *recorder = nullptr); //only windows around triggers are recorded
+    void FastForward(double duration, double shaftAccel) {m_motor->FastForward(duration, shaftAccel); m_time += duration;}
+    void Restart(int opmode);
+    SimSnapshot *Snapshot(void); //caller owns the snapshot
+    bool Restore(const SimSnapshot *snapshot); //false, with nothing changed, if the snapshot is from a different firmware build
+    MotorModel *getMotor(void) {return m_motor;}
+    void setFlightRecorder(double seconds, const QString &dumpFile); //0 seconds turns it off
+    FlightRecorder &getFlightRecorder(void) {return m_flight;}
+    void setTimestep(double val) {m_timestep = val; m_motor->setTimestep(val); m_flight.Reset(val);}
+    void setVdc(double val);
+    void setRunConfig(const RunConfig &config) {m_config = config; SelectLoop();}
+    const RunConfig &getRunConfig(void) {return m_config;}
+    void setTorqueDemand(double val) {m_config.torqueDemand = val;}
+    void setThrottleRamps(bool val) {m_config.throttleRamps = val; SelectLoop();}
+    void setExtraCycleDelay(bool val) {m_config.extraCycleDelay = val; SelectLoop();}
+    void setNoise(bool enable, double amplitude) {m_config.addNoise = enable; m_config.noiseAmp = amplitude; SelectLoop();}
+    void setTime(double val) {m_time = val;}
+    double getTime(void) {return m_time;}
+    double getStepTime(void) {return m_stepTime;} //time at which the last step was evaluated
+    double getTimestep(void) {return m_timestep;}
+    double getVdc(void) {return m_Vdc;}
+    double getTorqueDemand(void) {return m_config.torqueDemand;}
+    double getCtrlVa(void) {return m_ctrlVa;} //controller output including SVM component
+    double getCtrlVb(void) {return m_ctrlVb;}
+    double getCtrlVc(void) {return m_ctrlVc;}
+    double getVa(void) {return m_Va;} //phase voltages with SVM component removed
+    double getVb(void) {return m_Vb;}
+    double getVc(void) {return m_Vc;}
+
+private:
+    typedef void (SimEngine::*StepFunction)(void);
+    typedef void (SimEngine::*LoopFunction)(int num_steps, TraceRecorder *recorder);
+
+    void RunStep(void) {(this->*m_step)();}
+    template<bool throttleRamps, bool extraCycleDelay, bool addNoise> void SpecialisedStep(void);
+    template<bool throttleRamps, bool extraCycleDelay, bool addNoise> void SpecialisedLoop(int num_steps, TraceRecorder *recorder);
+    void SelectLoop(void);
+    void Record(TraceRecorder *recorder);
+    void FlightSample(void);
+
+    MotorModel *m_motor;
+    double m_time;
+    double m_stepTime;
+    double m_timestep;
+    double m_Vdc;
+    uint32_t m_old_time;
+    uint32_t m_old_ms_time;
+    double m_oldVa;
+    double m_oldVb;
+    double m_oldVc;
+    double m_ctrlVa, m_ctrlVb, m_ctrlVc;
+    double m_Va, m_Vb, m_Vc;
+
+    RunConfig m_config;
+    int m_lastTorqueDemand;
+    StepFunction m_step; //specialised for m_config
+    LoopFunction m_loop;
+    FlightRecorder m_flight; //last few seconds of every step, whatever the run records
+};
+
+#endif // SIMENGINE_H
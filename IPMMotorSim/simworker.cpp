@@ -0,0 +1,158 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "simworker.h"
+
+SimWorker::SimWorker(SimEngine *engine, QObject *parent)
+    :QThread(parent), m_engine{engine}, m_running{false}, m_quit{false}, m_generation{0}, m_stepsDone{0}, m_stepsQueued{0}
+{
+    for(int i = 0; i < WORKER_CHUNKS; i++)
+    {
+        m_chunks[i].reserve(WORKER_CHUNK_STEPS);
+        m_free.push(&m_chunks[i]);
+    }
+    start();
+}
+
+SimWorker::~SimWorker()
+{
+    Cancel();
+    m_mutex.lock();
+    m_quit = true;
+    m_wake.wakeAll();
+    m_mutex.unlock();
+    wait();
+}
+
+void SimWorker::Queue(int steps, const RunConfig &config, ChannelMask channels, TriggerCapture *trigger)
+{
+    QMutexLocker locker(&m_mutex);
+    if(!m_running && m_jobs.isEmpty()) //progress counts from the start of each batch of runs
+    {
+        m_stepsDone = 0;
+        m_stepsQueued = 0;
+    }
+    SimJob job = {steps, config, channels, m_generation, trigger};
+    m_jobs.append(job);
+    m_stepsQueued += steps;
+    m_wake.wakeAll();
+}
+
+//drops the queued jobs and stops the current one at the end of its chunk
+void SimWorker::Cancel(void)
+{
+    QMutexLocker locker(&m_mutex);
+    m_generation++;
+    m_jobs.clear();
+}
+
+//changes are kept in order with the runs, and unlike jobs aren't dropped by a cancel
+void SimWorker::Post(std::function<void(void)> change)
+{
+    QMutexLocker locker(&m_mutex);
+    m_changes.append(change);
+    m_wake.wakeAll();
+}
+
+void SimWorker::ApplyChanges(void)
+{
+    QList<std::function<void(void)>> changes;
+    m_mutex.lock();
+    changes.swap(m_changes);
+    m_mutex.unlock();
+    for(int i = 0; i < changes.size(); i++)
+        changes[i]();
+}
+
+bool SimWorker::isBusy(void)
+{
+    QMutexLocker locker(&m_mutex);
+    return m_running || !m_jobs.isEmpty() || !m_changes.isEmpty();
+}
+
+bool SimWorker::Collect(TraceRecorder *recorder)
+{
+    bool any = false;
+    TraceRecorder *chunk;
+    while(m_filled.pop(chunk))
+    {
+        recorder->append(*chunk);
+        m_free.push(chunk);
+        any = true;
+    }
+    return any;
+}
+
+void SimWorker::run()
+{
+    while(true)
+    {
+        m_mutex.lock();
+        while(m_jobs.isEmpty() && m_changes.isEmpty() && !m_quit)
+            m_wake.wait(&m_mutex);
+        if(m_quit)
+        {
+            m_mutex.unlock();
+            return;
+        }
+        bool haveJob = !m_jobs.isEmpty();
+        SimJob job;
+        if(haveJob)
+            job = m_jobs.takeFirst();
+        m_running = true; //also covers the changes, they are out of the queue but not yet made
+        m_mutex.unlock();
+
+        ApplyChanges();
+        if(haveJob)
+            RunJob(job);
+
+        m_mutex.lock();
+        m_running = false; //only after the last chunk is in the ring, see isBusy()
+        m_mutex.unlock();
+    }
+}
+
+void SimWorker::RunJob(const SimJob &job)
+{
+    m_engine->setRunConfig(job.config);
+    int done = 0;
+    while(done < job.steps && job.generation == m_generation)
+    {
+        TraceRecorder *chunk;
+        while(!m_free.pop(chunk)) //GUI is behind, wait for it to hand a chunk back
+        {
+            if(job.generation != m_generation)
+                return;
+            msleep(1);
+        }
+
+        ApplyChanges(); //live edits take effect between chunks
+        chunk->clear();
+        chunk->subscribe(this, job.channels);
+        int steps = qMin(WORKER_CHUNK_STEPS, job.steps - done);
+        if(job.trigger)
+            m_engine->RunTriggered(steps, job.trigger, chunk); //chunk only gets the captured windows
+        else
+            m_engine->RunFor(steps, chunk);
+        m_filled.push(chunk); //never full, there are more slots than chunks
+        done += steps;
+        m_stepsDone += steps;
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SIMWORKER_H
+#define SIMWORKER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QList>
+#include <atomic>
+#include <functional>
+#include "simengine.h"
+#include "tracerecorder.h"
+#include "spscring.h"
+
+#define WORKER_CHUNK_STEPS 8192 //steps per trace chunk handed to the GUI
+#define WORKER_CHUNKS 16 //chunks in flight, the worker waits when the GUI hasn't taken them
+
+struct SimJob
+{
+    int steps;
+    RunConfig config; //captured when the job was queued, so a sequence can change settings between its runs
+    ChannelMask channels;
+    int generation; //jobs from before a cancel are dropped
+    TriggerCapture *trigger; //null records every step
+};
+
+//Runs queued jobs on an engine in its own thread, publishing the traces as chunks through a lock free ring
+//While the worker is busy the engine, and the firmware Params, belong to it and must not be touched from elsewhere
+class SimWorker : public QThread
+{
+public:
+    explicit SimWorker(SimEngine *engine, QObject *parent = nullptr);
+    ~SimWorker();
+    void Queue(int steps, const RunConfig &config, ChannelMask channels, TriggerCapture *trigger = nullptr);
+    void Cancel(void);
+    void Post(std::function<void(void)> change); //made on the worker thread before its next chunk
+    bool Collect(TraceRecorder *recorder); //appends finished chunks, false if there were none
+    bool isBusy(void);
+    qint64 getStepsDone(void) {return m_stepsDone;}
+    qint64 getStepsQueued(void) {return m_stepsQueued;}
+
+protected:
+    void run();
+
+private:
+    void RunJob(const SimJob &job);
+    void ApplyChanges(void);
+
+    SimEngine *m_engine;
+    QMutex m_mutex; //guards the job and change queues and m_running
+    QWaitCondition m_wake;
+    QList<SimJob> m_jobs;
+    QList<std::function<void(void)>> m_changes; //engine, motor and Param changes from the GUI
+    bool m_running;
+    bool m_quit;
+    std::atomic<int> m_generation;
+    std::atomic<qint64> m_stepsDone;
+    std::atomic<qint64> m_stepsQueued;
+
+    TraceRecorder m_chunks[WORKER_CHUNKS];
+    SpscRing<TraceRecorder *, 2 * WORKER_CHUNKS> m_filled; //worker to GUI
+    SpscRing<TraceRecorder *, 2 * WORKER_CHUNKS> m_free; //GUI back to worker
+};
+
+#endif // SIMWORKER_H
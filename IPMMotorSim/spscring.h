@@ -0,0 +1,66 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+
+//Lock free ring for passing items from one thread to one other thread
+//Size must be a power of two, one slot is always left empty to tell a full ring from an empty one
+template<typename T, int Size> class SpscRing
+{
+    static_assert((Size & (Size - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+    SpscRing() :m_head{0}, m_tail{0} {}
+
+    //producer thread only, false if the ring is full
+    bool push(const T &item)
+    {
+        int head = m_head.load(std::memory_order_relaxed);
+        int next = (head + 1) & (Size - 1);
+        if(next == m_tail.load(std::memory_order_acquire))
+            return false;
+        m_items[head] = item;
+        m_head.store(next, std::memory_order_release); //publishes the item
+        return true;
+    }
+
+    //consumer thread only, false if the ring is empty
+    bool pop(T &item)
+    {
+        int tail = m_tail.load(std::memory_order_relaxed);
+        if(tail == m_head.load(std::memory_order_acquire))
+            return false;
+        item = m_items[tail];
+        m_tail.store((tail + 1) & (Size - 1), std::memory_order_release); //hands the slot back
+        return true;
+    }
+
+    bool isEmpty(void) const {return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);}
+
+private:
+    T m_items[Size];
+    alignas(64) std::atomic<int> m_head; //written by the producer
+    alignas(64) std::atomic<int> m_tail; //written by the consumer, own cache line so the two threads don't share one
+};
+
+#endif // SPSCRING_H
@@ -0,0 +1,116 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "steadystate.h"
+#include <QtMath>
+#include <string.h>
+
+static const char *channelNames[SS_COUNT] = {"Iq", "Id", "rpm", "cont_ud", "cont_uq"};
+
+SteadyStateDetector::SteadyStateDetector()
+    :m_relTol{0.005}, m_absTol{0.1}, m_periods{3}, m_maxWindow{0.1}
+{
+    for(int ch = 0; ch < SS_COUNT; ch++)
+        m_enabled[ch] = true;
+    Reset();
+}
+
+void SteadyStateDetector::Reset(void)
+{
+    for(int ch = 0; ch < SS_COUNT; ch++)
+    {
+        m_sum[ch] = 0;
+        m_mean[ch] = 0;
+        m_slope[ch] = 0;
+    }
+    m_count = 0;
+    m_windowStart = -1;
+    m_lastPosition = 0;
+    m_meanTime = 0;
+    m_haveMean = false;
+    m_settled = 0;
+    m_settleTime = 0;
+}
+
+const char *SteadyStateDetector::channelName(int channel)
+{
+    return channelNames[channel];
+}
+
+int SteadyStateDetector::channelIndex(const char *name)
+{
+    for(int ch = 0; ch < SS_COUNT; ch++)
+    {
+        if(strcmp(name, channelNames[ch]) == 0)
+            return ch;
+    }
+    return -1;
+}
+
+//returns true once the run is steady
+bool SteadyStateDetector::Sample(double time, double elecPosition, const double *values)
+{
+    if(m_windowStart < 0)
+    {
+        m_windowStart = time;
+        m_lastPosition = elecPosition;
+    }
+
+    //a period ends when the electrical angle wraps, in either direction
+    double delta = elecPosition - m_lastPosition;
+    m_lastPosition = elecPosition;
+    if(m_count > 0 && (qAbs(delta) > 180.0 || (time - m_windowStart) >= m_maxWindow))
+        EndWindow(time);
+
+    for(int ch = 0; ch < SS_COUNT; ch++)
+        m_sum[ch] += values[ch];
+    m_count++;
+
+    return isSteady();
+}
+
+void SteadyStateDetector::EndWindow(double time)
+{
+    double midTime = (m_windowStart + time) / 2;
+    bool within = m_haveMean;
+    for(int ch = 0; ch < SS_COUNT; ch++)
+    {
+        double mean = m_sum[ch] / m_count;
+        if(m_haveMean)
+        {
+            double change = mean - m_mean[ch];
+            m_slope[ch] = change / (midTime - m_meanTime);
+            if(m_enabled[ch] && qAbs(change) > qMax(m_absTol, m_relTol * qAbs(mean)))
+                within = false;
+        }
+        m_mean[ch] = mean;
+        m_sum[ch] = 0;
+    }
+
+    if(!isSteady())
+    {
+        m_settled = within ? (m_settled + 1) : 0;
+        m_settleTime = time;
+    }
+    m_haveMean = true;
+    m_meanTime = midTime;
+    m_windowStart = time;
+    m_count = 0;
+}
@@ -0,0 +1,76 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef STEADYSTATE_H
+#define STEADYSTATE_H
+
+enum SteadyChannel
+{
+    SS_IQ = 0, //motor dq currents
+    SS_ID,
+    SS_SPEED, //shaft rpm
+    SS_UD, //controller PI outputs
+    SS_UQ,
+    SS_COUNT
+};
+
+//Online steady state detector, fed once per simulation step
+//Each selected channel is averaged over an electrical period (or maxWindow at low speed) and the run is steady
+//once every channel's period mean has stayed within tolerance of the previous one for a number of periods
+class SteadyStateDetector
+{
+public:
+    SteadyStateDetector();
+    void setEnabled(int channel, bool enabled) {m_enabled[channel] = enabled;}
+    bool isEnabled(int channel) const {return m_enabled[channel];}
+    void setTolerance(double relative, double absolute) {m_relTol = relative; m_absTol = absolute;}
+    void setPeriods(int val) {m_periods = val;}
+    void setMaxWindow(double val) {m_maxWindow = val;}
+    void Reset(void);
+    bool Sample(double time, double elecPosition, const double *values);
+    bool isSteady(void) const {return m_settled >= m_periods;}
+    double getSettleTime(void) const {return m_settleTime;}
+    double getValue(int channel) const {return m_mean[channel];} //mean over the last complete period
+    double getSlope(int channel) const {return m_slope[channel];} //change per second between the last two periods
+    static const char *channelName(int channel);
+    static int channelIndex(const char *name);
+
+private:
+    void EndWindow(double time);
+
+    bool m_enabled[SS_COUNT];
+    double m_relTol;
+    double m_absTol;
+    int m_periods;
+    double m_maxWindow; //s
+
+    double m_sum[SS_COUNT];
+    int m_count;
+    double m_windowStart;
+    double m_lastPosition;
+    double m_mean[SS_COUNT];
+    double m_slope[SS_COUNT];
+    double m_meanTime; //mid point of the last complete window
+    bool m_haveMean;
+    int m_settled; //consecutive periods within tolerance
+    double m_settleTime;
+};
+
+#endif // STEADYSTATE_H
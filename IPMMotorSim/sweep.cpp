@@ -0,0 +1,390 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sweep.h"
+#include <QSettings>
+#include <QFile>
+#include <QMap>
+#include <QCryptographicHash>
+#include <QtMath>
+#include <string.h>
+#include "tracerecorder.h"
+#include "binlogwriter.h"
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+#define SWEEP_MAGIC "IPMSWP1"
+
+enum SweepStatus
+{
+    SWEEP_PENDING = 0,
+    SWEEP_RUNNING,
+    SWEEP_DONE,
+    SWEEP_FAILED
+};
+
+static const char *statusNames[] = {"pending", "running", "done", "failed"};
+
+
+//layout of the result file, a header then one fixed size record per grid point
+struct SweepHeader
+{
+    char magic[8];
+    quint64 key; //scenario file and grid, a mismatch means the results are from a different sweep
+    qint32 numPoints;
+    qint32 numAxes;
+    qint32 numMetrics;
+    qint32 recordSize;
+};
+
+struct SweepRecord
+{
+    qint32 status;
+    qint32 reserved;
+    double data[1]; //axis values then metrics
+};
+
+Sweep::Sweep()
+    :m_numPoints{0}
+{
+}
+
+//file hash and base scenario, shared with grids that have their own group
+bool Sweep::ReadFile(const QString &fileName, const Scenario &base)
+{
+    m_base = base;
+    m_axes.clear();
+
+    QFile file(fileName);
+    if(!file.open(QFile::ReadOnly))
+    {
+        m_error = "Unable to read " + fileName;
+        return false;
+    }
+    m_fileHash = QCryptographicHash::hash(file.readAll(), QCryptographicHash::Md5);
+    return true;
+}
+
+//list of values or a start:step:end range
+bool Sweep::ParseAxis(const QString &name, const QStringList &list, SweepAxis &axis)
+{
+    axis.name = name;
+    axis.values.clear();
+    QStringList range = (list.size() == 1) ? list[0].split(':') : QStringList();
+    bool ok = true;
+    if(range.size() == 3)
+    {
+        double start = range[0].toDouble(&ok);
+        double step = ok ? range[1].toDouble(&ok) : 0;
+        double end = ok ? range[2].toDouble(&ok) : 0;
+        if(ok && step > 0)
+        {
+            for(int i = 0; start + (i * step) <= end + (step * 1e-9); i++)
+                axis.values.append(start + (i * step));
+        }
+        else
+            ok = false;
+    }
+    else
+    {
+        for(const QString &v : list)
+        {
+            axis.values.append(v.trimmed().toDouble(&ok));
+            if(!ok)
+                break;
+        }
+    }
+
+    if(!ok || axis.values.isEmpty())
+    {
+        m_error = "Invalid sweep values for " + name;
+        return false;
+    }
+    return true;
+}
+
+bool Sweep::Load(const QString &fileName, const Scenario &base)
+{
+    if(!ReadFile(fileName, base))
+        return false;
+
+    QSettings settings(fileName, QSettings::IniFormat);
+    settings.beginGroup("Sweep");
+    for(const QString &key : settings.childKeys())
+    {
+        SweepAxis axis;
+        if(!ParseAxis(key, settings.value(key).toStringList(), axis))
+            return false;
+        if(!m_base.setValue(key, axis.values.first()))
+        {
+            m_error = "Unknown sweep parameter " + key;
+            return false;
+        }
+        m_axes.append(axis);
+    }
+    settings.endGroup();
+
+    if(m_axes.isEmpty())
+    {
+        m_error = "No [Sweep] parameters in " + fileName;
+        return false;
+    }
+
+    m_numPoints = 1;
+    for(const SweepAxis &axis : m_axes)
+        m_numPoints *= axis.values.size();
+    return true;
+}
+
+QStringList Sweep::MetricNames(void)
+{
+    return QStringList() << "final_rpm" << "mean_torque" << "torque_ripple" << "max_phase_current" << "rms_iq_err" << "rms_id_err";
+}
+
+//first axis varies slowest
+void Sweep::PointValues(int index, double *values)
+{
+    for(int a = m_axes.size() - 1; a >= 0; a--)
+    {
+        int n = m_axes[a].values.size();
+        values[a] = m_axes[a].values[index % n];
+        index /= n;
+    }
+}
+
+quint64 Sweep::Key(void)
+{
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(m_fileHash);
+    hash.addData(QByteArray::number(m_numPoints));
+    hash.addData(MetricNames().join(',').toLatin1());
+    quint64 key;
+    memcpy(&key, hash.result().constData(), sizeof(key));
+    return key;
+}
+
+Scenario Sweep::PointScenario(int index)
+{
+    Scenario point = m_base;
+    point.setFlightDump(m_base.getFileName() + QString(".point%1.flight.csv").arg(index));
+    point.setBinaryLog(m_base.getFileName() + QString(".point%1.bin").arg(index));
+    return point;
+}
+
+void Sweep::RunPoint(int index, double *metrics)
+{
+    Scenario point = PointScenario(index);
+    QVector<double> values(m_axes.size());
+    PointValues(index, values.data());
+    for(int a = 0; a < m_axes.size(); a++)
+        point.setValue(m_axes[a].name, values[a]);
+
+    SimEngine *engine = point.StartEngine();
+    TraceRecorder recorder;
+    recorder.subscribe(this, TR_CHANNEL(TR_TORQUE) | TR_CHANNEL(TR_SHAFT_RPM) | TR_CHANNEL(TR_IQ) | TR_CHANNEL(TR_ID) | TR_CHANNEL(TR_CIQ) |
+                             TR_CHANNEL(TR_CID) | TR_CHANNEL(TR_IA) | TR_CHANNEL(TR_IB) | TR_CHANNEL(TR_IC)); //just what the metrics use
+    point.RunSegments(engine, &recorder);
+    delete engine;
+
+    int n = recorder.count();
+    double sumTorque = 0, sumIqErr = 0, sumIdErr = 0, maxCurrent = 0;
+    for(int i = 0; i < n; i++)
+    {
+        sumTorque += recorder.value(TR_TORQUE, i);
+        double iqErr = recorder.value(TR_IQ, i) - recorder.value(TR_CIQ, i);
+        double idErr = recorder.value(TR_ID, i) - recorder.value(TR_CID, i);
+        sumIqErr += iqErr * iqErr;
+        sumIdErr += idErr * idErr;
+        for(int ch = TR_IA; ch <= TR_IC; ch++)
+            maxCurrent = qMax(maxCurrent, qAbs(recorder.value(ch, i)));
+    }
+
+    //ripple over the second half of the run, after the start transient
+    double sum = 0, sumSq = 0;
+    int half = n / 2;
+    for(int i = half; i < n; i++)
+    {
+        double t = recorder.value(TR_TORQUE, i);
+        sum += t;
+        sumSq += t * t;
+    }
+    int m = qMax(n - half, 1);
+    double mean = sum / m;
+
+    metrics[0] = (n > 0) ? recorder.value(TR_SHAFT_RPM, n - 1) : 0;
+    metrics[1] = sumTorque / qMax(n, 1);
+    metrics[2] = qSqrt(qMax((sumSq / m) - (mean * mean), 0.0));
+    metrics[3] = maxCurrent;
+    metrics[4] = qSqrt(sumIqErr / qMax(n, 1));
+    metrics[5] = qSqrt(sumIdErr / qMax(n, 1));
+}
+
+bool Sweep::Run(const QString &resultFile, int jobs, bool resume, QTextStream &log)
+{
+#ifdef Q_OS_UNIX
+    int numMetrics = MetricNames().size();
+    int recordSize = int(sizeof(SweepRecord) - sizeof(double)) + (int(sizeof(double)) * (m_axes.size() + numMetrics));
+    qint64 size = sizeof(SweepHeader) + (qint64(recordSize) * m_numPoints);
+
+    QFile file(resultFile);
+    if(!file.open(QFile::ReadWrite))
+    {
+        m_error = "Unable to open result file " + resultFile;
+        return false;
+    }
+
+    SweepHeader header;
+    bool reuse = resume && (file.size() == size) && (file.read((char *)&header, sizeof(header)) == sizeof(header)) &&
+                 (memcmp(header.magic, SWEEP_MAGIC, sizeof(header.magic)) == 0) && (header.key == Key());
+    if(!reuse)
+    {
+        file.resize(0);
+        file.resize(size); //zero filled, every point pending
+    }
+
+    uchar *map = file.map(0, size);
+    if(!map)
+    {
+        m_error = "Unable to map result file " + resultFile;
+        return false;
+    }
+    SweepHeader *hdr = (SweepHeader *)map;
+    if(!reuse)
+    {
+        memcpy(hdr->magic, SWEEP_MAGIC, sizeof(hdr->magic));
+        hdr->key = Key();
+        hdr->numPoints = m_numPoints;
+        hdr->numAxes = m_axes.size();
+        hdr->numMetrics = numMetrics;
+        hdr->recordSize = recordSize;
+    }
+    auto record = [&](int i) {return (SweepRecord *)(map + sizeof(SweepHeader) + (qint64(recordSize) * i));};
+
+    int done = 0;
+    for(int i = 0; i < m_numPoints; i++)
+    {
+        if(record(i)->status == SWEEP_DONE)
+            done++;
+    }
+    if(done)
+        log << "Resuming, " << done << " of " << m_numPoints << " points already done\n";
+    log.flush();
+
+    QMap<pid_t, int> running;
+    auto waitOne = [&]()
+    {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if(pid <= 0 || !running.contains(pid))
+            return;
+        int i = running.take(pid);
+        if(record(i)->status == SWEEP_DONE)
+            done++;
+        else
+            record(i)->status = SWEEP_FAILED;
+        log << "[" << done << "/" << m_numPoints << "] point " << i << ((record(i)->status == SWEEP_DONE) ? " done\n" : " failed\n");
+        log.flush();
+    };
+
+    for(int i = 0; i < m_numPoints; i++)
+    {
+        if(record(i)->status == SWEEP_DONE)
+            continue;
+        while(running.size() >= qMax(jobs, 1))
+            waitOne();
+
+        SweepRecord *rec = record(i);
+        PointValues(i, rec->data);
+        rec->status = SWEEP_RUNNING;
+        pid_t pid = fork();
+        if(pid == 0)
+        {
+            //worker, the firmware globals are this process's own copy
+            RunPoint(i, rec->data + m_axes.size());
+            BinaryLogWriter::terminalLog().Close(); //_exit() skips static destructors, this writes the last block
+            rec->status = SWEEP_DONE;
+            _exit(0);
+        }
+        else if(pid < 0)
+        {
+            rec->status = SWEEP_FAILED;
+            log << "fork failed for point " << i << "\n";
+            continue;
+        }
+        running[pid] = i;
+    }
+    while(!running.isEmpty())
+        waitOne();
+
+    file.unmap(map);
+    return true;
+#else
+    (void)resultFile;
+    (void)jobs;
+    (void)resume;
+    (void)log;
+    m_error = "Sweeps need fork(), not available on this platform";
+    return false;
+#endif
+}
+
+bool Sweep::WriteTable(const QString &resultFile, QTextStream &out)
+{
+    QFile file(resultFile);
+    if(!file.open(QFile::ReadOnly))
+    {
+        m_error = "Unable to read result file " + resultFile;
+        return false;
+    }
+    QByteArray data = file.readAll();
+    const SweepHeader *hdr = (const SweepHeader *)data.constData();
+    if(data.size() < int(sizeof(SweepHeader)) || memcmp(hdr->magic, SWEEP_MAGIC, sizeof(hdr->magic)) != 0 ||
+       data.size() < int(sizeof(SweepHeader)) + (hdr->recordSize * hdr->numPoints) ||
+       hdr->numAxes != m_axes.size() || hdr->numMetrics != MetricNames().size())
+    {
+        m_error = "Invalid result file " + resultFile;
+        return false;
+    }
+
+    out.setRealNumberPrecision(8);
+    out << "index";
+    for(const SweepAxis &axis : m_axes)
+        out << ',' << axis.name;
+    for(const QString &name : MetricNames())
+        out << ',' << name;
+    out << ",status\n";
+
+    for(int i = 0; i < hdr->numPoints; i++)
+    {
+        const SweepRecord *rec = (const SweepRecord *)(data.constData() + sizeof(SweepHeader) + (hdr->recordSize * i));
+        out << i;
+        for(int v = 0; v < hdr->numAxes + hdr->numMetrics; v++)
+        {
+            if(v < hdr->numAxes || rec->status == SWEEP_DONE)
+                out << ',' << rec->data[v];
+            else
+                out << ',';
+        }
+        out << ',' << statusNames[qBound(0, int(rec->status), int(SWEEP_FAILED))] << '\n';
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QTextStream>
+#include "scenario.h"
+
+struct SweepAxis
+{
+    QString name; //any [Parameters] field name
+    QVector<double> values;
+};
+
+//Parameter grid from the [Sweep] group of a scenario file, one key per swept field
+//  CurrentKp=1000, 2000, 4000   list of values
+//  SyncAdv=0:5:20               start:step:end
+//Every grid point runs in its own forked process, so each gets a fresh copy of the firmware globals
+//Results go into a memory mapped file that is left in place, so an interrupted sweep resumes where it stopped
+class Sweep
+{
+public:
+    Sweep();
+    virtual ~Sweep() {}
+    virtual bool Load(const QString &fileName, const Scenario &base);
+    QString getError(void) {return m_error;}
+    int getNumPoints(void) {return m_numPoints;}
+    bool Run(const QString &resultFile, int jobs, bool resume, QTextStream &log);
+    bool WriteTable(const QString &resultFile, QTextStream &out);
+
+protected:
+    virtual QStringList MetricNames(void);
+    virtual void RunPoint(int index, double *metrics);
+    bool ReadFile(const QString &fileName, const Scenario &base);
+    bool ParseAxis(const QString &name, const QStringList &list, SweepAxis &axis);
+    void PointValues(int index, double *values);
+    Scenario PointScenario(int index); //m_base with its own output files, points run side by side
+    quint64 Key(void);
+
+    Scenario m_base;
+    QList<SweepAxis> m_axes;
+    QByteArray m_fileHash;
+    int m_numPoints;
+    QString m_error;
+};
+
+#endif // SWEEP_H
@@ -1,6 +1,7 @@
-#include <QFile>
 #include <QTextStream>
+#include <QDebug>
 #include "terminal.h"
+#include "binlogwriter.h"
 #include "params.h"
 #include "terminalcommands.h"
 #include "my_fp.h"
@@ -47,21 +48,27 @@ bool Terminal::BinLoggingEnabled()
    return binLoggingEnabled;
 }
 
-static QFile logFile("logfile.bin");
+static QByteArray logHeader; //parameter JSON and binHeader, repeated at the start of each rotated file
 
+//called for every packet on the simulation thread, the file is written by BinaryLogWriter's own thread
 void Terminal::SendBinary(uint8_t* data, uint32_t len)
 {
-    if(!logFile.isOpen())
+    BinaryLogWriter &log = BinaryLogWriter::terminalLog();
+    if(!log.isOpen())
     {
-        logFile.open(QFile::WriteOnly);
+        if(log.hasFailed())
+            return; //don't retry the open for every packet
+        logHeader.clear();
         TerminalCommands::PrintParamsJson(this,nullptr);
-        logFile.write(binHeader, sizeof(binHeader));
+        logHeader.append(binHeader, sizeof(binHeader));
+        if(!log.Open(logHeader))
+        {
+            qWarning() << log.getError();
+            return;
+        }
     }
 
-    if(logFile.isOpen())
-    {
-        logFile.write(reinterpret_cast<char *>(data), len);
-    }
+    log.Append(reinterpret_cast<char *>(data), len);
 }
 
 void TerminalCommands::PrintParamsJson(Terminal* term, char *arg)
@@ -69,7 +76,7 @@ void TerminalCommands::PrintParamsJson(Terminal* term, char *arg)
    (void)term;
    (void)arg;
    //arg = my_trim(arg);
-    QTextStream out(&logFile);
+    QTextStream out(&logHeader, QIODevice::WriteOnly | QIODevice::Append);
     QString str;
 
    const Param::Attributes *pAtr;
@@ -87,14 +94,14 @@ void TerminalCommands::PrintParamsJson(Terminal* term, char *arg)
       if ((Param::GetFlag((Param::PARAM_NUM)idx) & Param::FLAG_HIDDEN) == 0 || printHidden)
       {
          //fprintf(term, "%c\r\n   \"%s\": {\"unit\":\"%s\",\"value\":%f,",comma, pAtr->name, pAtr->unit, Param::Get((Param::PARAM_NUM)idx));
-         str.asprintf("%c\r\n   \"%s\": {\"unit\":\"%s\",\"value\":%.2f,",comma, pAtr->name, pAtr->unit, Param::GetFloat((Param::PARAM_NUM)idx));
+         str = QString::asprintf("%c\r\n   \"%s\": {\"unit\":\"%s\",\"value\":%.2f,",comma, pAtr->name, pAtr->unit, Param::GetFloat((Param::PARAM_NUM)idx));
          out << str;
 
          if (Param::IsParam((Param::PARAM_NUM)idx))
          {
             //fprintf(term, "\"isparam\":true,\"minimum\":%f,\"maximum\":%f,\"default\":%f,\"category\":\"%s\",\"i\":%d}",
             //       pAtr->min, pAtr->max, pAtr->def, pAtr->category, idx);
-            str.asprintf("\"isparam\":true,\"minimum\":%.2f,\"maximum\":%.2f,\"default\":%.2f,\"category\":\"%s\",\"i\":%d}", FP_TOFLOAT(pAtr->min), FP_TOFLOAT(pAtr->max), FP_TOFLOAT(pAtr->def), pAtr->category, idx);
+            str = QString::asprintf("\"isparam\":true,\"minimum\":%.2f,\"maximum\":%.2f,\"default\":%.2f,\"category\":\"%s\",\"i\":%d}", FP_TOFLOAT(pAtr->min), FP_TOFLOAT(pAtr->max), FP_TOFLOAT(pAtr->def), pAtr->category, idx);
             out << str;
          }
          else
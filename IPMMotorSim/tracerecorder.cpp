@@ -0,0 +1,325 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tracerecorder.h"
+#include <QFile>
+#include <QTextStream>
+#include <string.h>
+#include <algorithm>
+
+static const char *channelNames[TR_COUNT] =
+{
+    "Ia", "Ib", "Ic", "Iq", "Id", "elec_freq", "motor_pos", "cont_pos",
+    "Va", "Vb", "Vc", "cont_vq", "cont_vd", "cont_iq", "cont_id", "cont_ifw",
+    "Vd", "Vq", "Vq_bemf", "Vq_LdId", "Vd_LqIq", "Vq_RqIq", "Vd_RdId", "VLd", "VLq",
+    "power", "torque", "elec_power", "efficiency", "rpm"
+};
+
+TraceRecorder::TraceRecorder()
+    :m_count{0}, m_capacity{0}, m_historyLimit{0}, m_generation{0}, m_discarded{0}
+{
+    for(int ch = 0; ch < TR_COUNT; ch++)
+    {
+        m_data[ch] = nullptr;
+        m_enabled[ch] = true;
+        m_written[ch] = 0;
+    }
+}
+
+//make sure there is room for a further number of steps, only allocates if the current capacity is exceeded
+//only the enabled columns are sized, setEnabled() grows a column when it is turned on
+void TraceRecorder::reserve(int steps)
+{
+    int needed = m_count + steps;
+    if(needed <= m_capacity)
+        return;
+
+    //grow by at least half again so that lots of short runs don't realloc every time
+    m_capacity = qMax(needed, m_capacity + (m_capacity / 2));
+
+    for(int ch = 0; ch < TR_COUNT; ch++)
+    {
+        if(m_enabled[ch])
+        {
+            m_columns[ch].resize(m_capacity);
+            m_data[ch] = m_columns[ch].data();
+        }
+    }
+}
+
+void TraceRecorder::clear(void)
+{
+    m_count = 0; //capacity is kept for the next run
+    m_generation++;
+    m_segments.clear();
+    for(int ch = 0; ch < TR_COUNT; ch++)
+        m_written[ch] = 0;
+}
+
+void TraceRecorder::truncate(int count)
+{
+    m_count = qBound(0, count, m_count);
+    m_generation++;
+    while(!m_segments.isEmpty() && m_segments.last().row >= m_count)
+        m_segments.removeLast();
+    for(int ch = 0; ch < TR_COUNT; ch++)
+        m_written[ch] = qMin(m_written[ch], m_count);
+}
+
+//the time of the first row kept becomes the start of its segment
+void TraceRecorder::discard(int count)
+{
+    count = qBound(0, count, m_count);
+    if(count == 0)
+        return;
+
+    for(int ch = 0; ch < TR_COUNT; ch++)
+    {
+        int n = rows(ch);
+        if(n > count)
+            memmove(m_data[ch], m_data[ch] + count, (n - count) * sizeof(TraceValue));
+        m_written[ch] = qMax(0, m_written[ch] - count);
+    }
+
+    if(count == m_count)
+        m_segments.clear();
+    else
+    {
+        int first = segmentAt(count);
+        double t0 = timeAt(count);
+        m_segments.erase(m_segments.begin(), m_segments.begin() + first);
+        m_segments[0].t0 = t0;
+        for(int i = 0; i < m_segments.size(); i++)
+            m_segments[i].row = qMax(0, m_segments[i].row - count);
+    }
+    m_count -= count;
+    m_discarded += count;
+}
+
+//a quarter more than the limit is held before trimming, so the rows are moved down now and then rather than on every append
+void TraceRecorder::setHistoryLimit(int rows)
+{
+    m_historyLimit = qMax(0, rows);
+    trim();
+}
+
+void TraceRecorder::trim(void)
+{
+    if(m_historyLimit > 0 && m_count > m_historyLimit + (m_historyLimit / 4))
+        discard(m_count - m_historyLimit);
+}
+
+void TraceRecorder::subscribe(const void *subscriber, ChannelMask channels)
+{
+    m_subscribers[subscriber] = channels;
+    applySubscriptions();
+}
+
+void TraceRecorder::unsubscribe(const void *subscriber)
+{
+    m_subscribers.remove(subscriber);
+    applySubscriptions();
+}
+
+void TraceRecorder::applySubscriptions(void)
+{
+    ChannelMask wanted = 0;
+    QMap<const void *, ChannelMask>::const_iterator i;
+    for (i = m_subscribers.constBegin(); i != m_subscribers.constEnd(); ++i)
+        wanted |= i.value();
+    if(m_subscribers.isEmpty())
+        wanted = ~ChannelMask(0);
+
+    for(int ch = 0; ch < TR_COUNT; ch++)
+        setEnabled(ch, (wanted & TR_CHANNEL(ch)) != 0);
+}
+
+//a channel picks up again after the rows it missed, which are filled with NaN so its column stays aligned with time
+void TraceRecorder::setEnabled(int channel, bool enabled)
+{
+    if(enabled == m_enabled[channel])
+        return;
+
+    if(enabled)
+    {
+        if(m_columns[channel].size() < m_capacity)
+        {
+            m_columns[channel].resize(m_capacity);
+            m_data[channel] = m_columns[channel].data();
+        }
+        std::fill(m_columns[channel].begin() + m_written[channel], m_columns[channel].begin() + m_count, std::numeric_limits<TraceValue>::quiet_NaN());
+        m_written[channel] = m_count;
+    }
+    else
+        m_written[channel] = m_count;
+    m_enabled[channel] = enabled;
+}
+
+ChannelMask TraceRecorder::enabledChannels(void) const
+{
+    ChannelMask mask = 0;
+    for(int ch = 0; ch < TR_COUNT; ch++)
+    {
+        if(m_enabled[ch])
+            mask |= TR_CHANNEL(ch);
+    }
+    return mask;
+}
+
+void TraceRecorder::append(const TraceRecorder &other, int first)
+{
+    reserve(other.count() - first);
+    for(int i = first; i < other.count(); i++)
+    {
+        for(int ch = 0; ch < TR_COUNT; ch++)
+            set(ch, other.value(ch, i));
+        commit(other.timeAt(i));
+    }
+    trim();
+}
+
+int TraceRecorder::segmentAt(int row) const
+{
+    int lo = 0, hi = m_segments.size() - 1;
+    while(lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if(m_segments[mid].row <= row)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+//min and max of rows [first, last) of a channel, NaN rows skipped, min and max are only ever widened
+void TraceRecorder::range(int channel, int first, int last, double &min, double &max) const
+{
+    if(last <= first)
+        return;
+
+    if(channel == TR_TIME) //the ends of each segment
+    {
+        for(int s = segmentAt(first); s < m_segments.size() && m_segments[s].row < last; s++)
+        {
+            int end = (s + 1 < m_segments.size()) ? qMin(last, m_segments[s + 1].row) : last;
+            double a = timeAt(qMax(first, m_segments[s].row));
+            double b = timeAt(end - 1);
+            min = qMin(min, qMin(a, b));
+            max = qMax(max, qMax(a, b));
+        }
+        return;
+    }
+
+    const TraceValue *y = m_columns[channel].constData();
+    last = qMin(last, rows(channel));
+    for(int i = first; i < last; i++)
+    {
+        if(qIsNaN(y[i]))
+            continue;
+        if(y[i] < min) min = y[i];
+        if(y[i] > max) max = y[i];
+    }
+}
+
+//narrow rows [first, last) to those within a time range, plus one either side so a line drawn from them reaches the edges
+//time only runs forward within a segment so the search is done segment by segment
+void TraceRecorder::timeRows(double minTime, double maxTime, int &first, int &last) const
+{
+    if(last <= first)
+        return;
+
+    int lo = last, hi = first;
+    for(int s = segmentAt(first); s < m_segments.size() && m_segments[s].row < last; s++)
+    {
+        const TimeSegment &seg = m_segments[s];
+        int start = qMax(first, seg.row);
+        int end = (s + 1 < m_segments.size()) ? qMin(last, m_segments[s + 1].row) : last;
+        int a = start, b = end;
+        if(seg.dt > 0)
+        {
+            a = qBound(start, int(qFloor((minTime - seg.t0) / seg.dt)) + seg.row, end);
+            b = qBound(start, int(qCeil((maxTime - seg.t0) / seg.dt)) + seg.row + 1, end);
+        }
+        else if(seg.t0 < minTime || seg.t0 > maxTime)
+            continue;
+        if(a < b)
+        {
+            lo = qMin(lo, a);
+            hi = qMax(hi, b);
+        }
+    }
+
+    if(lo >= hi)
+    {
+        last = first; //nothing visible
+        return;
+    }
+    first = qMax(first, lo - 1);
+    last = qMin(last, hi + 1);
+}
+
+const char *TraceRecorder::channelName(int channel)
+{
+    if(channel == TR_TIME)
+        return "time";
+    return channelNames[channel];
+}
+
+int TraceRecorder::channelIndex(const char *name)
+{
+    if(strcmp(name, "time") == 0)
+        return TR_TIME;
+    for(int ch = 0; ch < TR_COUNT; ch++)
+    {
+        if(strcmp(name, channelNames[ch]) == 0)
+            return ch;
+    }
+    return TR_COUNT;
+}
+
+bool TraceRecorder::writeCsv(const QString &fileName, int every) const
+{
+    QFile file(fileName);
+    if(!file.open(QFile::WriteOnly | QFile::Text))
+        return false;
+
+    QTextStream out(&file);
+    out.setRealNumberPrecision(8);
+
+    out << channelName(TR_TIME);
+    for(int ch = 0; ch < TR_COUNT; ch++)
+    {
+        if(m_enabled[ch])
+            out << ',' << channelName(ch);
+    }
+    out << '\n';
+
+    for(int i = 0; i < m_count; i += qMax(every, 1))
+    {
+        out << timeAt(i);
+        for(int ch = 0; ch < TR_COUNT; ch++)
+        {
+            if(m_enabled[ch])
+                out << ',' << m_columns[ch][i];
+        }
+        out << '\n';
+    }
+    return true;
+}
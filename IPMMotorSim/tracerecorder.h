@@ -0,0 +1,161 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <QVector>
+#include <QString>
+#include <QMap>
+#include <QtMath>
+#include <limits>
+
+enum TraceChannel
+{
+    TR_TIME = -1, //shared time column, not a channel in its own right
+    TR_IA = 0, //phase currents at the sampling point
+    TR_IB,
+    TR_IC,
+    TR_IQ,
+    TR_ID,
+    TR_ELEC_FREQ,
+    TR_MOTOR_POS,
+    TR_CONT_POS,
+    TR_CVA, //controller phase voltages including SVM
+    TR_CVB,
+    TR_CVC,
+    TR_CVQ,
+    TR_CVD,
+    TR_CIQ,
+    TR_CID,
+    TR_CIFW,
+    TR_VD, //motor dq voltages
+    TR_VQ,
+    TR_VQ_BEMF,
+    TR_VQ_DT_ID,
+    TR_VD_DT_IQ,
+    TR_VQ_DT_RQ,
+    TR_VD_DT_RD,
+    TR_VLD,
+    TR_VLQ,
+    TR_POWER, //kW
+    TR_TORQUE,
+    TR_ELEC_POWER, //kW
+    TR_EFFICIENCY,
+    TR_SHAFT_RPM,
+    TR_COUNT
+};
+
+//Channel storage, float halves the memory of a long run and is plenty for plotting
+//Build with CONFIG+=trace_double where full precision traces are wanted
+#ifdef TRACE_DOUBLE
+typedef double TraceValue;
+#else
+typedef float TraceValue;
+#endif
+
+typedef quint64 ChannelMask; //one bit per TraceChannel
+#define TR_CHANNEL(ch) (ChannelMask(1) << (ch))
+
+//Rows from row onwards are at t0 + n * dt, a new segment starts wherever the time steps out of line (restart, timestep change)
+struct TimeSegment
+{
+    int row;
+    double t0;
+    double dt; //0 until the segment has a second row
+};
+
+//Struct of arrays trace store, one contiguous column per channel and an implicit time axis
+//Enabled columns are sized up front by reserve() so that recording a step never allocates, disabled ones hold only the rows they were given
+class TraceRecorder
+{
+public:
+    TraceRecorder();
+    void reserve(int steps);
+    void clear(void);
+    void truncate(int count); //drop rows recorded after a branch point
+    void discard(int count); //drop the oldest rows, the rest move down to row 0
+    void setHistoryLimit(int rows); //rows kept by append() and trim(), 0 keeps everything
+    void trim(void);
+    int generation(void) const {return m_generation;} //changes whenever rows are dropped from the end, so indexes built on them are stale
+    qint64 discarded(void) const {return m_discarded;} //rows dropped from the front since the recorder was made
+    void subscribe(const void *subscriber, ChannelMask channels); //replaces the subscriber's channels
+    void unsubscribe(const void *subscriber);
+    bool isEnabled(int channel) const {return m_enabled[channel];}
+    ChannelMask enabledChannels(void) const;
+    void append(const TraceRecorder &other, int first = 0); //rows recorded elsewhere, e.g. chunks from a worker thread
+    int count(void) const {return m_count;}
+    int rows(int channel) const {return m_enabled[channel] ? m_count : m_written[channel];} //later rows read as NaN
+    double timeAt(int i) const
+    {
+        const TimeSegment *s = &m_segments.last();
+        if(i < s->row)
+            s = &m_segments[segmentAt(i)];
+        return s->t0 + (i - s->row) * s->dt;
+    }
+    double value(int channel, int i) const
+    {
+        if(channel == TR_TIME)
+            return timeAt(i);
+        return (i < rows(channel)) ? m_columns[channel][i] : std::numeric_limits<double>::quiet_NaN();
+    }
+    const TraceValue *column(int channel) const {return m_columns[channel].constData();} //not for TR_TIME
+    void range(int channel, int first, int last, double &min, double &max) const;
+    void timeRows(double minTime, double maxTime, int &first, int &last) const;
+    bool writeCsv(const QString &fileName, int every = 1) const;
+    static const char *channelName(int channel);
+    static int channelIndex(const char *name); //TR_COUNT if unknown
+
+    //recording interface, set the channels then commit the row
+    //only subscribed channels are written, the others cost no memory traffic and read back as NaN
+    void set(int channel, double value)
+    {
+        if(m_enabled[channel])
+            m_data[channel][m_count] = value;
+    }
+    void commit(double time)
+    {
+        TimeSegment *s = m_segments.isEmpty() ? nullptr : &m_segments.last();
+        int n = s ? m_count - s->row : 0;
+        if(s && n == 1 && time > s->t0)
+            s->dt = time - s->t0;
+        else if(!s || qAbs(s->t0 + n * s->dt - time) > s->dt * 1e-3) //accumulated m_time += m_timestep stays well inside this
+            m_segments.append({m_count, time, 0});
+        m_count++;
+    }
+
+private:
+    int segmentAt(int row) const;
+    void setEnabled(int channel, bool enabled);
+    void applySubscriptions(void);
+
+    QVector<TimeSegment> m_segments;
+    QVector<TraceValue> m_columns[TR_COUNT];
+    TraceValue *m_data[TR_COUNT]; //write pointers into the columns, only change in reserve() and setEnabled()
+    bool m_enabled[TR_COUNT];
+    int m_written[TR_COUNT]; //rows holding values (or NaN padding) while a channel is disabled
+    QMap<const void *, ChannelMask> m_subscribers; //no subscribers records every channel
+    int m_count;
+    int m_capacity;
+    int m_historyLimit;
+    int m_generation;
+    qint64 m_discarded; //a sliding ring or live history passes 2^31 rows in a few hours
+};
+
+#endif // TRACERECORDER_H
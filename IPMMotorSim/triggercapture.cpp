@@ -0,0 +1,174 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "triggercapture.h"
+#include <QStringList>
+#include <QtMath>
+#include <string.h>
+
+static const char *channelNames[TG_COUNT] = {"ocur", "pwm_off", "iq", "id", "ifw", "throttle"};
+
+TriggerCapture::TriggerCapture()
+    :m_pre{0.005}, m_post{0.02}, m_postRows{0}, m_haveLast{false}, m_remaining{0}, m_committed{0}
+{
+}
+
+const char *TriggerCapture::channelName(int channel)
+{
+    return channelNames[channel];
+}
+
+int TriggerCapture::channelIndex(const char *name)
+{
+    for(int ch = 0; ch < TG_COUNT; ch++)
+    {
+        if(strcmp(name, channelNames[ch]) == 0)
+            return ch;
+    }
+    return -1;
+}
+
+//comma separated, name>level for a level condition, name~level for a step and pre= post= for the window lengths in seconds
+//an empty spec turns triggering off
+bool TriggerCapture::Parse(const QString &spec)
+{
+    m_conditions.clear();
+    for(const QString &item : spec.split(','))
+    {
+        QString text = item.trimmed();
+        if(text.isEmpty())
+            continue;
+        int op = 0;
+        while(op < text.size() && !QString(">~=").contains(text[op]))
+            op++;
+        bool ok = false;
+        double value = (op > 0 && op < text.size()) ? text.mid(op + 1).trimmed().toDouble(&ok) : 0;
+        QString name = text.left(op).trimmed();
+        if(!ok)
+        {
+            m_error = "Invalid trigger condition: " + text;
+            return false;
+        }
+
+        if(text[op] == '=')
+        {
+            if(name == "pre")
+                m_pre = value;
+            else if(name == "post")
+                m_post = value;
+            else
+            {
+                m_error = "Unknown trigger setting: " + name;
+                return false;
+            }
+            continue;
+        }
+
+        int ch = channelIndex(name.toLatin1().constData());
+        if(ch < 0)
+        {
+            m_error = "Unknown trigger channel: " + name;
+            return false;
+        }
+        m_conditions.append({ch, text[op] == '~', value});
+    }
+    return true;
+}
+
+QString TriggerCapture::describe(int condition) const
+{
+    const TriggerCondition &c = m_conditions[condition];
+    return QString(channelNames[c.channel]) + (c.step ? "~" : ">") + QString::number(c.level);
+}
+
+void TriggerCapture::Reset(double timestep)
+{
+    int preRows = qMax(1, int(m_pre / timestep));
+    m_postRows = qMax(1, int(m_post / timestep));
+    m_ring.clear();
+    m_ring.reserve(preRows + (preRows / 4) + 1); //the most it holds before it is trimmed
+    m_ring.setHistoryLimit(preRows);
+    m_above.clear();
+    for(int i = 0; i < m_conditions.size(); i++)
+        m_above.append(false);
+    m_haveLast = false;
+    m_remaining = 0;
+    m_committed = m_ring.discarded();
+    m_events.clear();
+}
+
+void TriggerCapture::setChannels(ChannelMask channels)
+{
+    m_ring.subscribe(this, channels);
+}
+
+//true if any condition fires on this step, each firing condition is logged
+bool TriggerCapture::Fired(const double *values)
+{
+    bool fired = false;
+    double time = m_ring.timeAt(m_ring.count() - 1);
+    for(int i = 0; i < m_conditions.size(); i++)
+    {
+        const TriggerCondition &c = m_conditions[i];
+        bool hit;
+        if(c.step)
+            hit = m_haveLast && qAbs(values[c.channel] - m_last[c.channel]) > c.level;
+        else
+        {
+            bool above = qAbs(values[c.channel]) > c.level;
+            hit = above && !m_above[i];
+            m_above[i] = above;
+        }
+        if(hit)
+        {
+            m_events.append({time, i});
+            fired = true;
+        }
+    }
+    for(int ch = 0; ch < TG_COUNT; ch++)
+        m_last[ch] = values[ch];
+    m_haveLast = true;
+    return fired;
+}
+
+//copy ring rows from an absolute row number to the newest, skipping any that are already in the output
+void TriggerCapture::CommitFrom(qint64 row, TraceRecorder *out)
+{
+    row = qMax(row, m_committed);
+    qint64 end = m_ring.discarded() + m_ring.count();
+    if(out && row < end)
+        out->append(m_ring, int(row - m_ring.discarded()));
+    m_committed = end;
+}
+
+void TriggerCapture::Sample(const double *values, TraceRecorder *out)
+{
+    bool fired = Fired(values);
+    if(m_remaining > 0)
+    {
+        CommitFrom(m_committed, out);
+        m_remaining--;
+    }
+    else if(fired)
+        CommitFrom(m_ring.discarded(), out); //the whole ring is the pre-trigger window
+    if(fired)
+        m_remaining = m_postRows;
+    m_ring.trim();
+}
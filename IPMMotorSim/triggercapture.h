@@ -0,0 +1,91 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TRIGGERCAPTURE_H
+#define TRIGGERCAPTURE_H
+
+#include <QString>
+#include <QList>
+#include "tracerecorder.h"
+
+enum TriggerChannel
+{
+    TG_OCUR = 0, //largest phase current as a fraction of ocurlim
+    TG_PWM_OFF, //1 while the firmware has PWM disabled
+    TG_IQ, //motor dq currents
+    TG_ID,
+    TG_IFW, //controller field weakening current
+    TG_THROTTLE, //torque demand %
+    TG_COUNT
+};
+
+//Fires as |value| rises above level, or for a step condition as value changes by more than level in one step
+struct TriggerCondition
+{
+    int channel;
+    bool step;
+    double level;
+};
+
+struct TriggerEvent
+{
+    double time;
+    int condition; //index into the conditions
+};
+
+//Triggered capture, fed once per simulation step like the steady state detector
+//Every step goes into a pre-trigger ring at full resolution, only the windows around triggers reach the output recorder
+//A trigger inside a window extends it, so memory and trace size go with the number of events rather than the run length
+class TriggerCapture
+{
+public:
+    TriggerCapture();
+    bool Parse(const QString &spec); //e.g. "ocur>0.9, pwm_off>0.5, iq>300, throttle~5, pre=0.005, post=0.02"
+    QString getError(void) {return m_error;}
+    bool isEnabled(void) const {return !m_conditions.isEmpty();}
+    const QList<TriggerCondition> &getConditions(void) const {return m_conditions;}
+    void setWindow(double pre, double post) {m_pre = pre; m_post = post;} //s
+    void Reset(double timestep); //empties the ring and the event list
+    void setChannels(ChannelMask channels); //ring records the channels the output wants
+    TraceRecorder *getRing(void) {return &m_ring;} //the engine records each step here before Sample()
+    void Sample(const double *values, TraceRecorder *out);
+    const QList<TriggerEvent> &getEvents(void) const {return m_events;}
+    QString describe(int condition) const;
+    static const char *channelName(int channel);
+    static int channelIndex(const char *name);
+
+private:
+    bool Fired(const double *values);
+    void CommitFrom(qint64 row, TraceRecorder *out);
+
+    QList<TriggerCondition> m_conditions;
+    double m_pre, m_post; //s
+    int m_postRows;
+    TraceRecorder m_ring; //limited to the pre-trigger rows
+    QList<bool> m_above; //level conditions currently above their level
+    double m_last[TG_COUNT];
+    bool m_haveLast;
+    int m_remaining; //rows still to capture in the current window, 0 when armed
+    qint64 m_committed; //ring rows, counted from the start, already in the output
+    QList<TriggerEvent> m_events;
+    QString m_error;
+};
+
+#endif // TRIGGERCAPTURE_H
@@ -0,0 +1,127 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "warmstartcache.h"
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QDataStream>
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+#include <string.h>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable<MotorModel>::value, "motor model is stored as raw bytes");
+
+static const char warmMagic[8] = "IPMWRM1";
+
+WarmStartCache::WarmStartCache(const QString &directory)
+    :m_directory{directory}
+{
+}
+
+QString WarmStartCache::defaultDirectory(void)
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/warmstart";
+}
+
+//hash of the running executable, any rebuild of the firmware or simulator gives a new id
+QByteArray WarmStartCache::buildId(void)
+{
+    static QByteArray id;
+    if(id.isEmpty())
+    {
+        QFile exe(QCoreApplication::applicationFilePath());
+        QCryptographicHash hash(QCryptographicHash::Md5);
+        if(exe.open(QFile::ReadOnly))
+            hash.addData(&exe);
+        id = hash.result();
+    }
+    return id;
+}
+
+QString WarmStartCache::fileName(const QByteArray &paramKey)
+{
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(buildId());
+    hash.addData(paramKey);
+    return m_directory + "/" + QString::fromLatin1(hash.result().toHex()) + ".state";
+}
+
+SimSnapshot *WarmStartCache::Load(const QByteArray &paramKey, SimEngine *engine)
+{
+    if(!FirmwareContext::isSupported())
+        return nullptr;
+
+    QFile file(fileName(paramKey));
+    if(!file.open(QFile::ReadOnly))
+        return nullptr;
+
+    QDataStream in(&file);
+    char magic[8];
+    quint64 base;
+    qint32 firmwareSize, motorSize;
+    in.readRawData(magic, sizeof(magic));
+    in >> base >> firmwareSize >> motorSize;
+    if(in.status() != QDataStream::Ok || memcmp(magic, warmMagic, sizeof(magic)) != 0 ||
+            base != quint64(quintptr(FirmwareContext::stateData())) || firmwareSize != FirmwareContext::stateSize() ||
+            motorSize != int(sizeof(MotorModel)))
+        return nullptr;
+
+    SimSnapshot *snapshot = new SimSnapshot(*engine->getMotor());
+    snapshot->firmware.resize(firmwareSize);
+    in.readRawData(snapshot->firmware.data(), firmwareSize);
+    in.readRawData(reinterpret_cast<char *>(&snapshot->motor), motorSize);
+    in >> snapshot->time >> snapshot->stepTime >> snapshot->oldTime >> snapshot->oldMsTime;
+    in >> snapshot->oldVa >> snapshot->oldVb >> snapshot->oldVc;
+    in >> snapshot->ctrlVa >> snapshot->ctrlVb >> snapshot->ctrlVc;
+    in >> snapshot->Va >> snapshot->Vb >> snapshot->Vc;
+    in >> snapshot->lastTorqueDemand;
+    if(in.status() != QDataStream::Ok) //truncated file
+    {
+        delete snapshot;
+        return nullptr;
+    }
+    return snapshot;
+}
+
+//written to a temporary file and renamed so parallel jobs never see a partial state
+bool WarmStartCache::Save(const QByteArray &paramKey, const SimSnapshot *snapshot)
+{
+    if(!FirmwareContext::isSupported() || !QDir().mkpath(m_directory))
+        return false;
+
+    QSaveFile file(fileName(paramKey));
+    if(!file.open(QFile::WriteOnly))
+        return false;
+
+    QDataStream out(&file);
+    out.writeRawData(warmMagic, sizeof(warmMagic));
+    out << quint64(quintptr(FirmwareContext::stateData())) << qint32(snapshot->firmware.size()) << qint32(sizeof(MotorModel));
+    out.writeRawData(snapshot->firmware.constData(), snapshot->firmware.size());
+    out.writeRawData(reinterpret_cast<const char *>(&snapshot->motor), sizeof(MotorModel));
+    out << snapshot->time << snapshot->stepTime << snapshot->oldTime << snapshot->oldMsTime;
+    out << snapshot->oldVa << snapshot->oldVb << snapshot->oldVc;
+    out << snapshot->ctrlVa << snapshot->ctrlVb << snapshot->ctrlVc;
+    out << snapshot->Va << snapshot->Vb << snapshot->Vc;
+    out << snapshot->lastTorqueDemand;
+    return file.commit();
+}
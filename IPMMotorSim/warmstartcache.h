@@ -0,0 +1,45 @@
+/*
+ * This file is part of the IPMMotorSim project
+ *
+ * Copyright (C) 2022 Pete9008 <openinverter.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef WARMSTARTCACHE_H
+#define WARMSTARTCACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include "simengine.h"
+
+//On-disk store of the simulation state once the firmware start up sequence has completed
+//Files are named by a hash of the caller's parameter key and the simulator build so a stale state is never loaded
+//The firmware state holds absolute addresses so a file is only accepted by a build with the region at the same address
+class WarmStartCache
+{
+public:
+    WarmStartCache(const QString &directory = defaultDirectory());
+    static QString defaultDirectory(void);
+    static QByteArray buildId(void);
+    QString fileName(const QByteArray &paramKey);
+    SimSnapshot *Load(const QByteArray &paramKey, SimEngine *engine); //null if there is no usable state, caller owns the snapshot
+    bool Save(const QByteArray &paramKey, const SimSnapshot *snapshot);
+
+private:
+    QString m_directory;
+};
+
+#endif // WARMSTARTCACHE_H